@@ -0,0 +1,598 @@
+/*
+ * cmdl.c : Tests Of D3D9CMDL.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * A frame is made of command lists, each holding the same calls whichever
+ * thread records it. The reference records & replays them one after the
+ * other on one thread, into a device which hashes every call it receives
+ * with its arguments & payload. The threaded frames record the lists on
+ * 1, 2, 4 ... threads, which submit them to a queue the main thread keeps
+ * flushing meanwhile: every frame must reach the device as the same calls,
+ * in the same order.
+ *
+ * Also checks that a copied list replays the same, that a full list fails
+ * & stays as it was, as does a command whose size wraps in 32 bits, and
+ * that a failing call doesn't stop the replay.
+ *
+ *    cmdl [max threads] [lists per frame] [draws per list] [frames]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9CMDL.H"
+#include "D3D9FWD.H"
+#include "D3D9NULL.H"
+#include "TEST.H"
+
+//! A device hashing the calls it receives
+typedef struct TEST_DEVICE_T
+{
+	d3d9_fwd_device_t fwd   ;//!< Forwards to the null device, must be first
+	u64               hash  ;//!< Hash of the calls so far
+	u32               calls ;//!< Calls so far
+}
+test_device_t; //!< A device hashing the calls it receives
+
+//! The lists of a frame, recorded by the threads of test_parallel()
+typedef struct TEST_FRAME_T
+{
+	d3d9_cmdlist_t  * lists    ;//!< The lists
+	d3d9_cmdqueue_t * queue    ;//!< Queue the lists are submitted to, or nullp
+	u32               count    ;//!< Number of lists
+	u32               draws    ;//!< Draws per list
+	u32               sequence ;//!< Sequence number of the first list
+	u32               threads  ;//!< Threads recording the lists
+	u32               failed   ;//!< Lists which didn't fit
+}
+test_frame_t; //!< The lists of a frame
+
+//! Get the address an object number stands for, nullp for 0
+#define TEST_OBJECT( T, n ) ( (n) ? (T *)(hf_addr)( 0x10000u + (n) * 64u ) : (T *) nullp )
+
+//! The test device of a device
+#define TEST_DEVICE( p ) ( (test_device_t *)( p ) )
+
+//! Value of SetRenderState the test device fails
+#define TEST_FAIL 0xdeadu
+
+
+/****************************************************************************
+ * Hashing device
+ ****************************************************************************/
+
+//! Hashes bytes into a device
+static void test_hash( d3d9_device_t * p, const void * data, u32 bytes )
+{
+	const u08 * b = (const u08 *) data;
+	u64         h = TEST_DEVICE( p )->hash;
+	u32         i;
+
+	for ( i = 0; i < bytes; i++ )
+	{
+		h = ( h ^ b[i] ) * 1099511628211ull;
+	}
+
+	TEST_DEVICE( p )->hash = h;
+}
+
+//! Hashes the opcode & up to 4 arguments of a call
+static void test_call( d3d9_device_t * p, u32 op, u32 a, u32 b, u32 c, u32 d )
+{
+	u32 args[5];
+
+	args[0] = op;
+	args[1] = a;
+	args[2] = b;
+	args[3] = c;
+	args[4] = d;
+
+	test_hash( p, args, sizeof( args ) );
+
+	TEST_DEVICE( p )->calls++;
+}
+
+static hresult_t __stdcall test_set_render_state(
+	d3d9_device_t * p, d3d9_renderstatetype_t aState, u32 aValue )
+{
+	test_call( p, e_d3d9_cmd_renderstate, aState, aValue, 0, 0 );
+
+	return aValue == TEST_FAIL ? D3D9_ERR_INVALIDCALL : D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_sampler_state(
+	d3d9_device_t * p, u32 aSampler, d3d9_samplerstatetype_t aType, u32 aValue )
+{
+	test_call( p, e_d3d9_cmd_samplerstate, aSampler, aType, aValue, 0 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_texture(
+	d3d9_device_t * p, u32 aStage, d3d9_base_texture_t * pTexture )
+{
+	test_call( p, e_d3d9_cmd_texture, aStage, (u32)(hf_addr) pTexture, 0, 0 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_transform(
+	d3d9_device_t * p, d3d9_transformstatetype_t aState, const d3d9_matrix_t * pMatrix )
+{
+	test_call( p, e_d3d9_cmd_transform, aState, 0, 0, 0 );
+	test_hash( p, pMatrix, sizeof( d3d9_matrix_t ) );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_viewport( d3d9_device_t * p, const d3d9_viewport_t * pViewport )
+{
+	test_call( p, e_d3d9_cmd_viewport, 0, 0, 0, 0 );
+	test_hash( p, pViewport, sizeof( d3d9_viewport_t ) );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_vertex_shader( d3d9_device_t * p, d3d9_vertex_shader_t * pShader )
+{
+	test_call( p, e_d3d9_cmd_vertexshader, (u32)(hf_addr) pShader, 0, 0, 0 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_vertex_shader_constant_f(
+	d3d9_device_t * p, u32 startRegister, const float * pConstantData, u32 v4fCount )
+{
+	test_call( p, e_d3d9_cmd_vertexshaderconstantf, startRegister, v4fCount, 0, 0 );
+	test_hash( p, pConstantData, v4fCount * 16 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_pixel_shader_constant_b(
+	d3d9_device_t * p, u32 aStartRegister, const bool32 * pConstantData, u32 aBoolCount )
+{
+	test_call( p, e_d3d9_cmd_pixelshaderconstantb, aStartRegister, aBoolCount, 0, 0 );
+	test_hash( p, pConstantData, aBoolCount * sizeof( bool32 ) );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_stream_source(
+	d3d9_device_t * p, u32 streamNumber, d3d9_vertex_buffer_t * pStreamData,
+	u32 offsetInBytes, u32 aStride )
+{
+	test_call( p, e_d3d9_cmd_streamsource, streamNumber, (u32)(hf_addr) pStreamData,
+		offsetInBytes, aStride );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_stream_source_freq( d3d9_device_t * p, u32 aStreamNumber, u32 aSetting )
+{
+	test_call( p, e_d3d9_cmd_streamsourcefreq, aStreamNumber, aSetting, 0, 0 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_indices( d3d9_device_t * p, d3d9_index_buffer_t * pIndexData )
+{
+	test_call( p, e_d3d9_cmd_indices, (u32)(hf_addr) pIndexData, 0, 0, 0 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_draw_indexed_primitive(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, int baseVertexIndex,
+	u32 minVertexIndex, u32 numVertices, u32 startIndex, u32 primCount )
+{
+	test_call( p, e_d3d9_cmd_drawindexedprimitive, primitiveType, (u32) baseVertexIndex,
+		minVertexIndex, numVertices );
+	test_call( p, 0, startIndex, primCount, 0, 0 );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_draw_primitive_up(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, u32 primitiveCount,
+	const void * pVertexStreamZeroData, u32 aVertexStreamZeroStride )
+{
+	u64 vertices = d3d9_primitive_vertex_count( primitiveType, primitiveCount );
+
+	test_call( p, e_d3d9_cmd_drawprimitiveup, primitiveType, primitiveCount, aVertexStreamZeroStride, 0 );
+	test_hash( p, pVertexStreamZeroData, (u32)( vertices * aVertexStreamZeroStride ) );
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_draw_indexed_primitive_up(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, u32 minVertexIndex,
+	u32 numVertices, u32 aPrimitiveCount, const void * pIndexData,
+	d3d9_format_t aIndexDataFormat, const void * pVertexStreamZeroData,
+	u32 aVertexStreamZeroStride )
+{
+	u64 indices = d3d9_primitive_vertex_count( primitiveType, aPrimitiveCount );
+
+	test_call( p, e_d3d9_cmd_drawindexedprimitiveup, primitiveType, minVertexIndex, numVertices,
+		aPrimitiveCount );
+	test_hash( p, pIndexData, (u32)( indices * ( aIndexDataFormat == e_d3d9_fmt_index32 ? 4 : 2 ) ) );
+	test_hash( p, (const u08 *) pVertexStreamZeroData + minVertexIndex * aVertexStreamZeroStride,
+		numVertices * aVertexStreamZeroStride );
+
+	return D3D9_OK;
+}
+
+//! Creates a hashing device in front of a null device
+static d3d9_device_t * test_device_create( test_device_t * dev )
+{
+	d3d9_device_t      * null = d3d9_null_device_create( nullp );
+	d3d9_device_vtbl_t * v    = & dev->fwd.vtbl;
+
+	memset( dev, 0, sizeof( test_device_t ) );
+
+	d3d9_fwd_device_init( & dev->fwd, null, nullp );
+
+	null->vtbl->release( null );
+
+	v->setRenderState           = test_set_render_state;
+	v->setSamplerState          = test_set_sampler_state;
+	v->setTexture               = test_set_texture;
+	v->setTransform             = test_set_transform;
+	v->setViewport              = test_set_viewport;
+	v->setVertexShader          = test_set_vertex_shader;
+	v->setVertexShaderConstantF = test_set_vertex_shader_constant_f;
+	v->setPixelShaderConstantB  = test_set_pixel_shader_constant_b;
+	v->setStreamSource          = test_set_stream_source;
+	v->setStreamSourceFreq      = test_set_stream_source_freq;
+	v->setIndices               = test_set_indices;
+	v->drawIndexedPrimitive     = test_draw_indexed_primitive;
+	v->drawPrimitiveUP          = test_draw_primitive_up;
+	v->drawIndexedPrimitiveUP   = test_draw_indexed_primitive_up;
+
+	return & dev->fwd.device;
+}
+
+//! Forgets the calls a device has received
+static void test_device_clear( test_device_t * dev )
+{
+	dev->hash  = 14695981039346656037ull;
+	dev->calls = 0;
+}
+
+
+/****************************************************************************
+ * Frames
+ ****************************************************************************/
+
+//! Records list @p index of a frame: the draws of one part of the scene,
+//! with their constants, transforms & a few user pointer draws
+static hbool test_record( d3d9_cmdlist_t * list, u32 index, u32 draws )
+{
+	static const u16 quad[6] = { 0, 1, 2, 2, 1, 3 };
+	d3d9_viewport_t  vp;
+	d3d9_matrix_t    m;
+	f32              c[ 4 * 4 ];
+	f32              up[ 4 * 4 ];
+	bool32           b[3];
+	hbool            ok   = hf_true;
+	u32              seed = index + 1;
+	u32              i;
+	u32              k;
+
+	vp.x      = index * 16;
+	vp.y      = 0;
+	vp.width  = 640;
+	vp.height = 480;
+	vp.minz   = 0.0f;
+	vp.maxz   = 1.0f;
+
+	ok &= d3d9_cmdlist_set_viewport( list, & vp );
+
+	for ( i = 0; i < draws; i++ )
+	{
+		u32 mesh = test_rand( & seed ) % 256;
+
+		for ( k = 0; k < 16; k++ )
+		{
+			c[k] = (f32)( index * draws + i ) + (f32) k * 0.25f;
+		}
+
+		if ( i % 16 == 0 )
+		{
+			for ( k = 0; k < 16; k++ )
+			{
+				m[k] = (f32)( test_rand( & seed ) % 1000 ) * 0.001f;
+			}
+
+			ok &= d3d9_cmdlist_set_transform( list, e_d3d9_ts_view, & m );
+			ok &= d3d9_cmdlist_set_vertex_shader( list, TEST_OBJECT( d3d9_vertex_shader_t, 1 + index % 4 ) );
+			ok &= d3d9_cmdlist_set_render_state( list, e_d3d9_rs_cullmode, 1 + i % 3 );
+		}
+
+		ok &= d3d9_cmdlist_set_texture( list, 0, TEST_OBJECT( d3d9_base_texture_t, 1 + mesh % 40 ) );
+		ok &= d3d9_cmdlist_set_sampler_state( list, 0, e_d3d9_samp_addressu, 1 + mesh % 3 );
+		ok &= d3d9_cmdlist_set_vertex_shader_constant_f( list, 4, c, 4 );
+		ok &= d3d9_cmdlist_set_stream_source( list, 0, TEST_OBJECT( d3d9_vertex_buffer_t, 100 + mesh ),
+		                                      mesh * 32, 32 );
+		ok &= d3d9_cmdlist_set_indices( list, TEST_OBJECT( d3d9_index_buffer_t, 400 + mesh ) );
+
+		if ( mesh % 8 == 0 )
+		{
+			ok &= d3d9_cmdlist_set_stream_source_freq( list, 0, 0x40000000u | ( 1 + mesh % 5 ) );
+		}
+
+		ok &= d3d9_cmdlist_draw_indexed_primitive( list, e_d3d9_pt_trianglelist, (int)( mesh % 7 ) - 3,
+		                                           0, 24 + mesh, mesh * 3, 8 + mesh % 17 );
+
+		if ( mesh % 8 == 0 )
+		{
+			ok &= d3d9_cmdlist_set_stream_source_freq( list, 0, 1 );
+		}
+
+		if ( i % 32 == 31 )
+		{
+			for ( k = 0; k < 16; k++ )
+			{
+				up[k] = (f32)( index + i + k );
+			}
+
+			b[0] = (bool32)( i & 1 );
+			b[1] = 1;
+			b[2] = (bool32)( index & 1 );
+
+			ok &= d3d9_cmdlist_set_pixel_shader_constant_b( list, 2, b, 3 );
+			ok &= d3d9_cmdlist_draw_primitive_up( list, e_d3d9_pt_trianglestrip, 2, up, 16 );
+			ok &= d3d9_cmdlist_draw_indexed_primitive_up( list, e_d3d9_pt_trianglelist, 0, 4, 2, quad,
+			                                              e_d3d9_fmt_index16, up, 16 );
+		}
+	}
+
+	return ok;
+}
+
+//! Records list @p index of a frame & submits it (d3d9_task_fn_t)
+static void test_record_task( void * ctx, u32 index )
+{
+	test_frame_t   * f    = (test_frame_t *) ctx;
+	d3d9_cmdlist_t * list = & f->lists[ index ];
+
+	d3d9_cmdlist_reset( list );
+
+	if ( !test_record( list, index, f->draws ) )
+	{
+		D3D9_ATOMIC_ADD_U32( & f->failed, 1 );
+	}
+
+	if ( f->queue )
+	{
+		d3d9_cmdqueue_submit( f->queue, f->sequence + index, list );
+	}
+}
+
+//! Runs the threads recording a frame
+static void * test_record_thread( void * arg )
+{
+	test_frame_t * f = (test_frame_t *) arg;
+
+	test_parallel_run( (void *)(hf_addr) f->threads, test_record_task, f, f->count );
+
+	return nullp;
+}
+
+/**
+ * Records a frame on @p threads threads while the calling thread replays
+ * the submitted lists.
+ *
+ * @return the ticks it took
+ */
+static u64 test_frame( test_frame_t * f, u32 threads, d3d9_device_t * device )
+{
+	pthread_t thread;
+	u32       replayed = 0;
+	u64       t0       = d3d9_ticks();
+
+	f->threads = threads;
+	f->failed  = 0;
+
+	if ( pthread_create( & thread, nullp, test_record_thread, f ) )
+	{
+		TEST_CHECK( !"pthread_create" );
+
+		return 0;
+	}
+
+	while ( replayed < f->count )
+	{
+		replayed += d3d9_cmdqueue_flush( f->queue, device );
+	}
+
+	pthread_join( thread, nullp );
+
+	f->sequence += f->count;
+
+	return d3d9_ticks() - t0;
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! A copied list replays the same calls, a full list stays as it was
+static void test_list( void )
+{
+	test_device_t   dev;
+	d3d9_device_t * d = test_device_create( & dev );
+	d3d9_cmdlist_t  list;
+	d3d9_cmdlist_t  copy;
+	d3d9_cmdlist_t  small;
+	u64             hash;
+	u32             calls;
+	u32             used;
+	u32             count;
+	u16             data[ 32 ];
+
+	memset( data, 0, sizeof( data ) );
+	TEST_CHECK( d3d9_cmdlist_init( & list, 1 << 20 ) );
+	TEST_CHECK( test_record( & list, 7, 100 ) && !list.overflow );
+
+	test_device_clear( & dev );
+	TEST_CHECK( d3d9_cmdlist_replay( & list, d ) == D3D9_OK );
+	hash  = dev.hash;
+	calls = dev.calls;
+
+	// the payload is found by offsets, so a moved buffer replays the same
+	TEST_CHECK( d3d9_cmdlist_init( & copy, list.capacity ) );
+	memcpy( copy.base, list.base, list.used );
+	copy.used  = list.used;
+	copy.count = list.count;
+	d3d9_cmdlist_free( & list );
+
+	test_device_clear( & dev );
+	TEST_CHECK( d3d9_cmdlist_replay( & copy, d ) == D3D9_OK );
+	TEST_CHECK( dev.hash == hash && dev.calls == calls );
+
+	// a failing call is returned, the calls after it are still made
+	d3d9_cmdlist_reset( & copy );
+	TEST_CHECK( d3d9_cmdlist_set_render_state( & copy, e_d3d9_rs_zenable, TEST_FAIL ) );
+	TEST_CHECK( d3d9_cmdlist_set_render_state( & copy, e_d3d9_rs_zenable, 1 ) );
+	test_device_clear( & dev );
+	TEST_CHECK( d3d9_cmdlist_replay( & copy, d ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( dev.calls == 2 );
+	d3d9_cmdlist_free( & copy );
+
+	// a full list refuses the command & keeps the ones before it
+	TEST_CHECK( d3d9_cmdlist_init( & small, 256 ) );
+	TEST_CHECK( !test_record( & small, 0, 10 ) && small.overflow );
+	TEST_CHECK( small.used <= small.capacity && small.count > 0 );
+	used  = small.used;
+	count = small.count;
+	TEST_CHECK( !d3d9_cmdlist_set_render_state( & small, e_d3d9_rs_zenable, 1 ) );
+	TEST_CHECK( small.used == used && small.count == count );
+	test_device_clear( & dev );
+	TEST_CHECK( d3d9_cmdlist_replay( & small, d ) == D3D9_OK );
+	TEST_CHECK( dev.calls >= count );
+	d3d9_cmdlist_reset( & small );
+	TEST_CHECK( !small.overflow && small.used == 0 );
+
+	// sizes which wrap in 32 bits are too large, not small
+	TEST_CHECK( !d3d9_cmdlist_set_vertex_shader_constant_f( & small, 0, (const float *) data, 0x10000001 ) );
+	TEST_CHECK( small.overflow && small.used == 0 );
+	d3d9_cmdlist_reset( & small );
+	TEST_CHECK( !d3d9_cmdlist_draw_primitive_up( & small, e_d3d9_pt_trianglelist, 0x55555556, data, 4 ) );
+	TEST_CHECK( small.overflow && small.used == 0 );
+	d3d9_cmdlist_reset( & small );
+	TEST_CHECK( !d3d9_cmdlist_draw_indexed_primitive_up( & small, e_d3d9_pt_trianglelist, 0xFFFFFFF0,
+		0x20, 1, data, e_d3d9_fmt_index16, data, 4 ) );
+	TEST_CHECK( small.overflow && small.used == 0 );
+	d3d9_cmdlist_free( & small );
+
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+}
+
+//! Threaded frames replay the calls of the reference, in order
+static void test_threads( u32 max, u32 count, u32 draws, u32 frames )
+{
+	test_device_t    dev;
+	d3d9_device_t  * d     = test_device_create( & dev );
+	d3d9_cmdlist_t * lists = (d3d9_cmdlist_t *) calloc( count, sizeof( d3d9_cmdlist_t ) );
+	d3d9_cmdqueue_t  queue;
+	test_frame_t     f;
+	u64              hash;
+	u64              best;
+	u64              one   = 0;
+	u64              rec;
+	u32              calls;
+	u32              threads;
+	u32              i;
+
+	for ( i = 0; i < count; i++ )
+	{
+		TEST_CHECK( d3d9_cmdlist_init( & lists[i], 64 + draws * 512 ) );
+	}
+
+	TEST_CHECK( d3d9_cmdqueue_init( & queue, count ) );
+
+	// the reference: one list at a time, recorded & replayed
+	test_device_clear( & dev );
+	best = d3d9_ticks();
+
+	for ( i = 0; i < count; i++ )
+	{
+		d3d9_cmdlist_reset( & lists[0] );
+		TEST_CHECK( test_record( & lists[0], i, draws ) );
+		d3d9_cmdlist_replay( & lists[0], d );
+	}
+
+	best  = d3d9_ticks() - best;
+	hash  = dev.hash;
+	calls = dev.calls;
+
+	printf( "cmdl: %u lists of %u draws, %u calls, %.2f ms recorded & replayed on one thread\n",
+		count, draws, calls, test_ms( best ) );
+
+	f.lists    = lists;
+	f.queue    = & queue;
+	f.count    = count;
+	f.draws    = draws;
+	f.sequence = 0;
+
+	for ( threads = 1; threads <= max; threads *= 2 )
+	{
+		best = ~(u64) 0;
+
+		for ( i = 0; i < frames; i++ )
+		{
+			u64 t;
+
+			test_device_clear( & dev );
+
+			t = test_frame( & f, threads, d );
+
+			TEST_CHECK( f.failed == 0 );
+			TEST_CHECK( dev.hash == hash && dev.calls == calls );
+
+			best = t < best ? t : best;
+		}
+
+		one = threads == 1 ? best : one;
+
+		// the recording alone, without the replay
+		f.queue   = nullp;
+		f.threads = threads;
+		rec       = d3d9_ticks();
+		test_parallel_run( (void *)(hf_addr) threads, test_record_task, & f, count );
+		rec       = d3d9_ticks() - rec;
+		f.queue   = & queue;
+
+		printf( "cmdl: %2u threads recording, %.2f ms a frame, %.2fx, recording alone %.2f ms\n",
+			threads, test_ms( best ), (double) one / (double) best, test_ms( rec ) );
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		d3d9_cmdlist_free( & lists[i] );
+	}
+
+	d3d9_cmdqueue_free( & queue );
+	free( lists );
+
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+}
+
+int main( int argc, char ** argv )
+{
+	u32 threads = test_arg( argc, argv, 1, 8 );
+	u32 lists   = test_arg( argc, argv, 2, 64 );
+	u32 draws   = test_arg( argc, argv, 3, 500 );
+	u32 frames  = test_arg( argc, argv, 4, 10 );
+
+	test_list();
+	test_threads( threads, lists, draws, frames );
+
+	return test_done( "cmdl" );
+}
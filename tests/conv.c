@@ -0,0 +1,1236 @@
+/*
+ * conv.c : Tests Of D3D9CONV.H & D3D9DXTC.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * Every pair of formats is converted by each instruction set the CPU has
+ * and on threads, at odd sizes, with padded & negative pitches. The result
+ * must be the one of the scalar kernels, byte for byte, and the padding
+ * between the rows must be left alone.
+ *
+ * The scalar kernels are checked in turn against a reference written here
+ * from the layouts of the formats: each format is decoded to float RGBA,
+ * and encoded from A8R8G8B8 and from float RGBA, channels rounded to the
+ * nearest level. Every half is converted to float and back, and random
+ * floats & the midpoints between halves are rounded to nearest even.
+ *
+ * The DXT decoder must give the palettes of known blocks, and the encoder
+ * must reproduce solid colors within a step of R5G6B5, keep the alpha of
+ * DXT1 to transparent or opaque, of DXT2 / DXT3 within a step of 4 bits
+ * and of DXT4 / DXT5 within a step of its palette, and keep the error of
+ * gradients & noise within bounds.
+ *
+ * Then prints the MB/s of a few pairs by instruction set, and on threads.
+ *
+ *    conv [benchmark size] [threads]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9CONV.H"
+#include "TEST.H"
+
+#include <math.h>
+
+//! Bytes of padding after each row of the images compared
+#define TEST_PADDING 12
+
+//! Kinds of formats, by how their channels are stored
+enum
+{
+	e_test_packed = 0, //!< Integer channels, read through A8R8G8B8
+	e_test_wide   = 1, //!< Integer channels, read through float RGBA
+	e_test_lum    = 2, //!< Luminance in the R channel, maybe alpha
+	e_test_half   = 3, //!< Half channels
+	e_test_float  = 4, //!< Float channels
+	e_test_dxt    = 5, //!< DXT blocks
+};
+
+//! A format & the layout of its channels
+typedef struct TEST_FORMAT_T
+{
+	d3d9_format_t format   ;//!< The format
+	u32           bytes    ;//!< Bytes per pixel (or per block)
+	u32           kind     ;//!< e_test_*
+	u32           channels ;//!< Channels stored, of half & float formats
+	u32           x        ;//!< Alpha bits are unused (written as ones)
+	u32           shift[4] ;//!< Shift of R, G, B & A in the pixel
+	u32           bits[4]  ;//!< Bits of R, G, B & A, 0 if missing (read as 1)
+}
+test_format_t; //!< A format & the layout of its channels
+
+//! An image & its memory
+typedef struct TEST_IMAGE_T
+{
+	d3d9_image_t image ;//!< The image
+	u08        * mem   ;//!< Its memory
+	u32          size  ;//!< Bytes of mem
+	u32          row   ;//!< Bytes of a row (or row of blocks), without padding
+	u32          rows  ;//!< Rows (or rows of blocks)
+}
+test_image_t; //!< An image & its memory
+
+//! The supported formats
+static const test_format_t g_test_formats[] =
+{
+	{ e_d3d9_fmt_a8r8g8b8,       4, e_test_packed, 0, 0, { 16,  8,  0, 24 }, {  8,  8,  8, 8 } },
+	{ e_d3d9_fmt_x8r8g8b8,       4, e_test_packed, 0, 1, { 16,  8,  0, 24 }, {  8,  8,  8, 8 } },
+	{ e_d3d9_fmt_a8b8g8r8,       4, e_test_packed, 0, 0, {  0,  8, 16, 24 }, {  8,  8,  8, 8 } },
+	{ e_d3d9_fmt_x8b8g8r8,       4, e_test_packed, 0, 1, {  0,  8, 16, 24 }, {  8,  8,  8, 8 } },
+	{ e_d3d9_fmt_r5g6b5,         2, e_test_packed, 0, 0, { 11,  5,  0,  0 }, {  5,  6,  5, 0 } },
+	{ e_d3d9_fmt_x1r5g5b5,       2, e_test_packed, 0, 1, { 10,  5,  0, 15 }, {  5,  5,  5, 1 } },
+	{ e_d3d9_fmt_a1r5g5b5,       2, e_test_packed, 0, 0, { 10,  5,  0, 15 }, {  5,  5,  5, 1 } },
+	{ e_d3d9_fmt_a4r4g4b4,       2, e_test_packed, 0, 0, {  8,  4,  0, 12 }, {  4,  4,  4, 4 } },
+	{ e_d3d9_fmt_L8,             1, e_test_lum,    0, 0, {  0,  0,  0,  0 }, {  8,  0,  0, 0 } },
+	{ e_d3d9_fmt_A8L8,           2, e_test_lum,    0, 0, {  0,  0,  0,  8 }, {  8,  0,  0, 8 } },
+	{ e_d3d9_fmt_a2r10g10b10,    4, e_test_wide,   0, 0, { 20, 10,  0, 30 }, { 10, 10, 10, 2 } },
+	{ e_d3d9_fmt_r16f,           2, e_test_half,   1, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_g16r16f,        4, e_test_half,   2, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_a16b16g16r16f,  8, e_test_half,   4, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_r32f,           4, e_test_float,  1, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_g32r32f,        8, e_test_float,  2, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_a32b32g32r32f, 16, e_test_float,  4, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_dxt1,           8, e_test_dxt,    0, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_dxt2,          16, e_test_dxt,    0, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_dxt3,          16, e_test_dxt,    0, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_dxt4,          16, e_test_dxt,    0, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+	{ e_d3d9_fmt_dxt5,          16, e_test_dxt,    0, 0, {  0,  0,  0,  0 }, {  0,  0,  0, 0 } },
+};
+
+//! Number of supported formats
+#define TEST_FORMATS ( sizeof( g_test_formats ) / sizeof( g_test_formats[0] ) )
+
+//! Names of the instruction sets
+static const char * const g_test_isa[3] = { "scalar", "sse2", "avx2" };
+
+
+/****************************************************************************
+ * Images
+ ****************************************************************************/
+
+//! Get the format of a d3d9_format_t
+static const test_format_t * test_format( d3d9_format_t format )
+{
+	u32 i;
+
+	for ( i = 0; i < TEST_FORMATS; i++ )
+	{
+		if ( g_test_formats[i].format == format )
+		{
+			return & g_test_formats[i];
+		}
+	}
+
+	return nullp;
+}
+
+//! Makes an image, its rows @p pad bytes apart, upside down if @p flip
+static void test_image( test_image_t * t, d3d9_format_t format, u32 w, u32 h, u32 pad, hbool flip )
+{
+	const test_format_t * f = test_format( format );
+
+	if ( f->kind == e_test_dxt )
+	{
+		t->row  = ( w + 3 ) / 4 * f->bytes;
+		t->rows = ( h + 3 ) / 4;
+	}
+	else
+	{
+		t->row  = w * f->bytes;
+		t->rows = h;
+	}
+
+	t->size = ( t->row + pad ) * t->rows;
+	t->mem  = (u08 *) calloc( t->size, 1 );
+
+	t->image.bits   = (hf_addr) t->mem;
+	t->image.pitch  = (s32)( t->row + pad );
+	t->image.width  = w;
+	t->image.height = h;
+	t->image.format = format;
+
+	if ( flip )
+	{
+		t->image.bits  += (hf_addr) t->image.pitch * ( t->rows - 1 );
+		t->image.pitch  = -t->image.pitch;
+	}
+}
+
+//! Frees an image
+static void test_image_free( test_image_t * t )
+{
+	free( t->mem );
+}
+
+//! Fills the memory of an image with random bytes, floats mostly in range
+static void test_fill( test_image_t * t, u32 seed )
+{
+	const test_format_t * f = test_format( t->image.format );
+	u32                   i;
+
+	for ( i = 0; i < t->size; i++ )
+	{
+		t->mem[i] = (u08) test_rand( & seed );
+	}
+
+	if ( f->kind != e_test_float )
+	{
+		return;
+	}
+
+	// random bits are mostly NaN or out of range, keep one float in 4
+	for ( i = 0; i + 4 <= t->size; i += 4 )
+	{
+		if ( test_rand( & seed ) & 3 )
+		{
+			f32 v = (f32)( test_rand( & seed ) % 1500 ) / 1000.0f - 0.25f;
+
+			memcpy( t->mem + i, & v, 4 );
+		}
+	}
+}
+
+//! Get pixel (or block) @p x of row (or row of blocks) @p y
+static u08 * test_pixel( const test_image_t * t, u32 x, u32 y )
+{
+	return (u08 *) t->image.bits + (s64) t->image.pitch * y + x * test_format( t->image.format )->bytes;
+}
+
+
+/****************************************************************************
+ * Reference
+ ****************************************************************************/
+
+//! Get the value of a half
+static f64 test_half_value( u32 h )
+{
+	u32 e = h >> 10 & 31;
+	u32 m = h & 1023;
+	f64 v;
+
+	if ( e == 31 )
+	{
+		v = m ? NAN : INFINITY;
+	}
+	else
+	{
+		v = e ? ldexp( 1024 + m, (int) e - 25 ) : ldexp( m, -24 );
+	}
+
+	return h & 0x8000 ? -v : v;
+}
+
+//! Get the half nearest to a float, ties to even
+static u32 test_half( f32 f )
+{
+	u32 s  = signbit( f ) ? 0x8000 : 0;
+	f64 a  = fabs( (f64) f );
+	u32 lo = 0;
+	u32 hi = 0x7BFF;
+
+	if ( isnan( f ) )
+	{
+		return s | 0x7E00;
+	}
+
+	if ( a >= 65520.0 ) // 65504 and half a step
+	{
+		return s | 0x7C00;
+	}
+
+	// the largest half not above a
+	while ( lo < hi )
+	{
+		u32 mid = ( lo + hi + 1 ) / 2;
+
+		if ( test_half_value( mid ) <= a )
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	if ( a - test_half_value( lo ) > test_half_value( lo + 1 ) - a
+	  || ( a - test_half_value( lo ) == test_half_value( lo + 1 ) - a && ( lo & 1 ) ) )
+	{
+		lo++;
+	}
+
+	return s | lo;
+}
+
+//! Whether two halves are the same, any NaN of a sign being the same
+static hbool test_half_same( u32 a, u32 b )
+{
+	if ( ( a & 0x7FFF ) > 0x7C00 && ( b & 0x7FFF ) > 0x7C00 )
+	{
+		return ( a & 0x8000 ) == ( b & 0x8000 );
+	}
+
+	return a == b;
+}
+
+//! Expands @p v of @p bits to 8 bits, repeating its bits
+static u32 test_expand8( u32 v, u32 bits )
+{
+	u32 r = 0;
+	s32 s;
+
+	for ( s = 8 - (s32) bits; s > -(s32) bits; s -= (s32) bits )
+	{
+		r |= s >= 0 ? v << s : v >> -s;
+	}
+
+	return r;
+}
+
+//! Get the level of @p max nearest to the 8-bit @p v
+static u32 test_level( u32 v, u32 max )
+{
+	return ( 2 * v * max + 255 ) / 510;
+}
+
+//! Get the luminance of 8-bit red, green & blue
+static u32 test_luminance( u32 r, u32 g, u32 b )
+{
+	return ( 77 * r + 150 * g + 29 * b + 128 ) >> 8;
+}
+
+//! Reads the bytes of a pixel
+static u32 test_read( const test_format_t * f, const u08 * p )
+{
+	u32 v = 0;
+
+	memcpy( & v, p, f->bytes < 4 ? f->bytes : 4 );
+
+	return v;
+}
+
+//! Decodes a pixel to float RGBA
+static void test_decode( const test_format_t * f, const u08 * p, f64 c[4] )
+{
+	u32 v = test_read( f, p );
+	u32 i;
+
+	for ( i = 0; i < 4; i++ )
+	{
+		u32 max = ( 1u << f->bits[i] ) - 1;
+		u32 x   = v >> f->shift[i] & max;
+		u16 h;
+		f32 s;
+
+		switch ( f->kind )
+		{
+		case e_test_packed:
+		case e_test_lum:
+			c[i] = ( i == 3 && f->x ) || !f->bits[i] ? 1.0 : test_expand8( x, f->bits[i] ) / 255.0;
+			break;
+
+		case e_test_wide:
+			c[i] = (f64) x / max;
+			break;
+
+		case e_test_half:
+			c[i] = 1.0;
+
+			if ( i < f->channels )
+			{
+				memcpy( & h, p + 2 * i, 2 );
+				c[i] = test_half_value( h );
+			}
+			break;
+
+		case e_test_float:
+			c[i] = 1.0;
+
+			if ( i < f->channels )
+			{
+				memcpy( & s, p + 4 * i, 4 );
+				c[i] = s;
+			}
+			break;
+		}
+	}
+
+	if ( f->kind == e_test_lum )
+	{
+		c[1] = c[2] = c[0];
+	}
+}
+
+//! Encodes an A8R8G8B8 pixel, @return its bytes
+static u32 test_encode8( const test_format_t * f, u32 argb, u08 * p )
+{
+	u32 c[4];
+	u32 v = 0;
+	u32 i;
+
+	c[0] = argb >> 16 & 255;
+	c[1] = argb >>  8 & 255;
+	c[2] = argb       & 255;
+	c[3] = argb >> 24;
+
+	if ( f->kind == e_test_lum )
+	{
+		c[0] = test_luminance( c[0], c[1], c[2] );
+	}
+
+	for ( i = 0; i < 4; i++ )
+	{
+		u32 max = ( 1u << f->bits[i] ) - 1;
+		u16 h;
+		f32 s;
+
+		switch ( f->kind )
+		{
+		case e_test_packed:
+		case e_test_wide:
+		case e_test_lum:
+			if ( f->bits[i] )
+			{
+				v |= ( i == 3 && f->x ? max : test_level( c[i], max ) ) << f->shift[i];
+			}
+			break;
+
+		case e_test_half:
+			h = (u16) test_half( (f32) c[i] / 255.0f );
+
+			if ( i < f->channels )
+			{
+				memcpy( p + 2 * i, & h, 2 );
+			}
+			break;
+
+		case e_test_float:
+			s = (f32) c[i] / 255.0f;
+
+			if ( i < f->channels )
+			{
+				memcpy( p + 4 * i, & s, 4 );
+			}
+			break;
+		}
+	}
+
+	if ( f->kind != e_test_half && f->kind != e_test_float )
+	{
+		memcpy( p, & v, f->bytes );
+	}
+
+	return f->bytes;
+}
+
+//! Clamps to [0, 1], NaN to 0
+static f64 test_sat( f32 x )
+{
+	return x > 0.0f ? ( x < 1.0f ? x : 1.0 ) : 0.0;
+}
+
+//! Checks a pixel encoded from float RGBA, @return whether it's right
+static hbool test_check_float( const test_format_t * f, const f32 in[4], const u08 * p )
+{
+	f64 c[4];
+	u32 i;
+
+	if ( f->kind == e_test_half )
+	{
+		for ( i = 0; i < f->channels; i++ )
+		{
+			u16 h;
+
+			memcpy( & h, p + 2 * i, 2 );
+
+			if ( !test_half_same( h, test_half( in[i] ) ) )
+			{
+				return hf_false;
+			}
+		}
+
+		return hf_true;
+	}
+
+	if ( f->kind == e_test_float )
+	{
+		return memcmp( p, in, 4 * f->channels ) == 0;
+	}
+
+	test_decode( f, p, c );
+
+	if ( f->kind == e_test_lum )
+	{
+		// each channel is rounded to 8 bits first, maybe the other way at a tie
+		u32 l = test_luminance(
+			(u32) floor( test_sat( in[0] ) * 255.0 + 0.5 ),
+			(u32) floor( test_sat( in[1] ) * 255.0 + 0.5 ),
+			(u32) floor( test_sat( in[2] ) * 255.0 + 0.5 ) );
+
+		if ( fabs( c[0] * 255.0 - l ) > 1.0 + 1e-6 )
+		{
+			return hf_false;
+		}
+
+		i = 3;
+	}
+	else
+	{
+		i = 0;
+	}
+
+	for ( ; i < 4; i++ )
+	{
+		u32 max = ( 1u << f->bits[i] ) - 1;
+		f64 tol = 1e-6;
+
+		if ( !f->bits[i] || ( i == 3 && f->x ) )
+		{
+			if ( c[i] != 1.0 )
+			{
+				return hf_false;
+			}
+
+			continue;
+		}
+
+		// half a step of the channel, of A8R8G8B8 on the way there, and
+		// the expansion of the channel to 8 bits
+		tol += 0.5 / max;
+		tol += f->kind == e_test_wide || max == 255 ? 0.0 : 1.0 / 255.0;
+
+		if ( fabs( c[i] - test_sat( in[i] ) ) > tol )
+		{
+			return hf_false;
+		}
+	}
+
+	return hf_true;
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! Converts @p src to a new image of @p format, the same for every run
+static void test_convert(
+	test_image_t          * dst,
+	const test_image_t    * src,
+	d3d9_format_t           format,
+	hbool                   flip,
+	const d3d9_parallel_t * par )
+{
+	test_image( dst, format, src->image.width, src->image.height, TEST_PADDING, flip );
+	test_fill( dst, 0xC0DE );
+
+	TEST_CHECK( d3d9_conv_image( & dst->image, & src->image, par ) == D3D9_OK );
+}
+
+//! Compares every pair of formats, by instruction set & on threads
+static void test_pairs( u32 threads )
+{
+	static const u32 sizes[][2] = { { 1, 1 }, { 3, 5 }, { 7, 3 }, { 67, 9 }, { 130, 33 }, { 17, 6 } };
+	d3d9_parallel_t  par        = test_parallel( threads );
+	u32              isa        = d3d9_conv_isa();
+	u32              runs       = 0;
+	u32              bad        = 0;
+	u32              si;
+	u32              di;
+	u32              z;
+	u32              i;
+	u32              y;
+
+	for ( si = 0; si < TEST_FORMATS; si++ )
+	{
+		for ( di = 0; di < TEST_FORMATS; di++ )
+		{
+			for ( z = 0; z < sizeof( sizes ) / sizeof( sizes[0] ); z++ )
+			{
+				test_image_t src;
+				test_image_t ref;
+				test_image_t pad;
+
+				test_image( & src, g_test_formats[ si ].format, sizes[z][0], sizes[z][1], 4, z & 1 );
+				test_fill( & src, si * 1000 + z );
+
+				d3d9_conv_set_isa( e_d3d9_conv_scalar );
+				test_convert( & ref, & src, g_test_formats[ di ].format, z == 3, nullp );
+
+				// the padding is as filled
+				test_image( & pad, g_test_formats[ di ].format, sizes[z][0], sizes[z][1], TEST_PADDING, z == 3 );
+				test_fill( & pad, 0xC0DE );
+
+				for ( y = 0; y < ref.rows; y++ )
+				{
+					u08 * r = test_pixel( & ref, 0, y ) + ref.row;
+					u08 * p = test_pixel( & pad, 0, y ) + ref.row;
+
+					bad += memcmp( r, p, TEST_PADDING ) != 0;
+				}
+
+				// each instruction set, then the best one on threads
+				for ( i = 1; i <= isa + 1; i++ )
+				{
+					test_image_t out;
+
+					d3d9_conv_set_isa( i <= isa ? i : isa );
+					test_convert( & out, & src, g_test_formats[ di ].format, z == 3, i <= isa ? nullp : & par );
+
+					if ( memcmp( out.mem, ref.mem, ref.size ) )
+					{
+						printf( "conv: %s to %s, %ux%u, %s%s differs from scalar\n",
+							d3d9_fmt_string( g_test_formats[ si ].format ),
+							d3d9_fmt_string( g_test_formats[ di ].format ),
+							sizes[z][0], sizes[z][1], g_test_isa[ i <= isa ? i : isa ],
+							i <= isa ? "" : " on threads" );
+						bad++;
+					}
+
+					test_image_free( & out );
+					runs++;
+				}
+
+				test_image_free( & pad );
+				test_image_free( & ref );
+				test_image_free( & src );
+			}
+		}
+	}
+
+	d3d9_conv_set_isa( isa );
+
+	TEST_CHECK( bad == 0 );
+
+	printf( "conv: %u formats, %u conversions compared to scalar (up to %s, %u threads)\n",
+		(u32) TEST_FORMATS, runs, g_test_isa[ isa ], threads );
+}
+
+//! Converts several images at once, as one by one
+static void test_levels( u32 threads )
+{
+	d3d9_parallel_t par = test_parallel( threads );
+	test_image_t    src[4];
+	test_image_t    dst[4];
+	test_image_t    one;
+	d3d9_image_t    s[4];
+	d3d9_image_t    d[4];
+	u32             i;
+
+	for ( i = 0; i < 4; i++ )
+	{
+		test_image( & src[i], e_d3d9_fmt_a8r8g8b8, 300 >> i, 203 >> i, 0, hf_false );
+		test_image( & dst[i], e_d3d9_fmt_dxt5, 300 >> i, 203 >> i, TEST_PADDING, hf_false );
+		test_fill( & dst[i], 0xC0DE );
+		test_fill( & src[i], i );
+
+		s[i] = src[i].image;
+		d[i] = dst[i].image;
+	}
+
+	TEST_CHECK( d3d9_conv_images( d, s, 4, & par ) == D3D9_OK );
+
+	for ( i = 0; i < 4; i++ )
+	{
+		test_convert( & one, & src[i], e_d3d9_fmt_dxt5, hf_false, nullp );
+
+		TEST_CHECK( memcmp( one.mem, dst[i].mem, dst[i].size ) == 0 );
+
+		test_image_free( & one );
+	}
+
+	// nothing is converted if an image can't be
+	memset( dst[0].mem, 0xAB, dst[0].size );
+
+	s[2].format = e_d3d9_fmt_v8u8;
+
+	TEST_CHECK( d3d9_conv_images( d, s, 4, & par ) == D3D9_ERR_WRONGTEXTUREFORMAT );
+	TEST_CHECK( dst[0].mem[0] == 0xAB && dst[0].mem[ dst[0].size - 1 ] == 0xAB );
+
+	s[2].format = e_d3d9_fmt_a8r8g8b8;
+	s[2].width++;
+
+	TEST_CHECK( d3d9_conv_images( d, s, 4, & par ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( dst[0].mem[0] == 0xAB && dst[0].mem[ dst[0].size - 1 ] == 0xAB );
+
+	TEST_CHECK( !d3d9_conv_supported( e_d3d9_fmt_unknown ) );
+	TEST_CHECK( !d3d9_conv_supported( e_d3d9_fmt_r8g8b8 ) );
+	TEST_CHECK( d3d9_conv_supported( e_d3d9_fmt_dxt3 ) );
+
+	for ( i = 0; i < 4; i++ )
+	{
+		test_image_free( & src[i] );
+		test_image_free( & dst[i] );
+	}
+}
+
+//! Checks the kernels against the reference
+static void test_reference( void )
+{
+	u32 unpacked = 0;
+	u32 packed   = 0;
+	u32 floats   = 0;
+	u32 fi;
+	u32 x;
+	u32 y;
+
+	for ( fi = 0; fi < TEST_FORMATS; fi++ )
+	{
+		const test_format_t * f = & g_test_formats[ fi ];
+		test_image_t          src;
+		test_image_t          dst;
+		u32                   bad = 0;
+
+		if ( f->kind == e_test_dxt )
+		{
+			continue;
+		}
+
+		// decoded to float RGBA
+		test_image( & src, f->format, 61, 7, 0, hf_false );
+		test_fill( & src, fi );
+		test_convert( & dst, & src, e_d3d9_fmt_a32b32g32r32f, hf_false, nullp );
+
+		for ( y = 0; y < 7; y++ )
+		{
+			for ( x = 0; x < 61; x++ )
+			{
+				const f32 * out = (const f32 *) test_pixel( & dst, x, y );
+				f64         c[4];
+				u32         i;
+
+				test_decode( f, test_pixel( & src, x, y ), c );
+
+				for ( i = 0; i < 4; i++ )
+				{
+					f64 tol = 1e-6 * ( fabs( c[i] ) > 1.0 ? fabs( c[i] ) : 1.0 );
+
+					bad += isnan( c[i] ) ? !isnan( out[i] )
+					     : out[i] != c[i] && !( fabs( out[i] - c[i] ) <= tol );
+				}
+
+				unpacked++;
+			}
+		}
+
+		test_image_free( & dst );
+		test_image_free( & src );
+
+		// encoded from A8R8G8B8
+		test_image( & src, e_d3d9_fmt_a8r8g8b8, 61, 7, 0, hf_false );
+		test_fill( & src, fi + 100 );
+		test_convert( & dst, & src, f->format, hf_false, nullp );
+
+		for ( y = 0; y < 7; y++ )
+		{
+			for ( x = 0; x < 61; x++ )
+			{
+				u08 p[16];
+				u32 argb;
+
+				memcpy( & argb, test_pixel( & src, x, y ), 4 );
+
+				bad += memcmp( test_pixel( & dst, x, y ), p, test_encode8( f, argb, p ) ) != 0;
+				packed++;
+			}
+		}
+
+		test_image_free( & dst );
+		test_image_free( & src );
+
+		// encoded from float RGBA
+		test_image( & src, e_d3d9_fmt_a32b32g32r32f, 61, 7, 0, hf_false );
+		test_fill( & src, fi + 200 );
+
+		{
+			static const f32 special[] = { 0.0f, 1.0f, 0.5f, -0.0f, 2.0f, -1.0f, 1e-40f, 65504.0f, 65520.0f, 1e30f };
+			f32            * s         = (f32 *) src.mem;
+			u32              nan       = 0x7FC00001u;
+			u32              i;
+
+			for ( i = 0; i < sizeof( special ) / sizeof( special[0] ); i++ )
+			{
+				s[ 4 * i     ] = special[i];
+				s[ 4 * i + 1 ] = -special[i];
+				s[ 4 * i + 2 ] = special[i] * 0.25f;
+			}
+
+			memcpy( & s[3], & nan, 4 );
+		}
+
+		test_convert( & dst, & src, f->format, hf_false, nullp );
+
+		for ( y = 0; y < 7; y++ )
+		{
+			for ( x = 0; x < 61; x++ )
+			{
+				bad += !test_check_float( f, (const f32 *) test_pixel( & src, x, y ), test_pixel( & dst, x, y ) );
+				floats++;
+			}
+		}
+
+		test_image_free( & dst );
+		test_image_free( & src );
+
+		if ( bad )
+		{
+			printf( "conv: %s differs from the reference %u times\n", d3d9_fmt_string( f->format ), bad );
+		}
+
+		TEST_CHECK( bad == 0 );
+	}
+
+	printf( "conv: %u pixels decoded, %u encoded from A8R8G8B8, %u from float RGBA, as the reference\n",
+		unpacked, packed, floats );
+}
+
+//! Converts every half to float & back, and random floats to halves
+static void test_halves( void )
+{
+	test_image_t halves;
+	test_image_t floats;
+	test_image_t back;
+	u32          isa  = d3d9_conv_isa();
+	u32          seed = 7;
+	u32          bad  = 0;
+	u32          n    = 0;
+	u32          i;
+	u32          k;
+
+	test_image( & halves, e_d3d9_fmt_r16f, 256, 256, 0, hf_false );
+
+	for ( i = 0; i < 65536; i++ )
+	{
+		u16 h = (u16) i;
+
+		memcpy( halves.mem + 2 * i, & h, 2 );
+	}
+
+	test_convert( & floats, & halves, e_d3d9_fmt_r32f, hf_false, nullp );
+	test_convert( & back, & floats, e_d3d9_fmt_r16f, hf_false, nullp );
+
+	for ( i = 0; i < 65536; i++ )
+	{
+		f64 v = test_half_value( i );
+		f32 f;
+		u16 h;
+
+		memcpy( & f, test_pixel( & floats, i & 255, i >> 8 ), 4 );
+		memcpy( & h, test_pixel( & back, i & 255, i >> 8 ), 2 );
+
+		bad += isnan( v ) ? !isnan( f ) : (f64) f != v || !signbit( f ) != !signbit( v );
+		bad += !test_half_same( h, i );
+	}
+
+	TEST_CHECK( bad == 0 );
+
+	test_image_free( & back );
+	test_image_free( & floats );
+	test_image_free( & halves );
+
+	// random floats, and the midpoints of halves & their neighbours
+	test_image( & floats, e_d3d9_fmt_a32b32g32r32f, 256, 256, 0, hf_false );
+
+	for ( i = 0; i < floats.size / 4; i++ )
+	{
+		u32 x = test_rand( & seed ) << 8 | ( test_rand( & seed ) & 255 );
+		f32 f;
+
+		if ( i & 1 )
+		{
+			u32 h = test_rand( & seed ) % 0x7BFF;
+			u32 j = i >> 2 & 3;
+
+			f = (f32)( ( test_half_value( h ) + test_half_value( h + 1 ) ) / 2 );
+			f = ( i & 2 ) ? -f : f;
+			memcpy( & x, & f, 4 );
+
+			// below, at, above & at the midpoint
+			x = j == 0 ? x - 1 : j == 2 ? x + 1 : x;
+		}
+
+		memcpy( floats.mem + 4 * i, & x, 4 );
+	}
+
+	for ( k = 0; k <= isa; k++ )
+	{
+		d3d9_conv_set_isa( k );
+		test_convert( & back, & floats, e_d3d9_fmt_a16b16g16r16f, hf_false, nullp );
+
+		for ( i = 0; i < floats.size / 4; i++ )
+		{
+			f32 f;
+			u16 h;
+
+			memcpy( & f, floats.mem + 4 * i, 4 );
+			memcpy( & h, test_pixel( & back, i >> 2 & 255, i >> 10 ) + 2 * ( i & 3 ), 2 );
+
+			bad += !test_half_same( h, test_half( f ) );
+			n++;
+		}
+
+		test_image_free( & back );
+	}
+
+	d3d9_conv_set_isa( isa );
+	test_image_free( & floats );
+
+	TEST_CHECK( bad == 0 );
+
+	printf( "conv: 65536 halves to float & back, %u floats to halves (up to %s) as the reference\n",
+		n, g_test_isa[ isa ] );
+}
+
+//! Decodes blocks of known palettes
+static void test_dxt_known( void )
+{
+	u08          block[16];
+	d3d9_color_t c[16];
+
+	// red & blue, 4 colors by thirds
+	memset( block, 0, sizeof( block ) );
+	block[1] = 0xF8;
+	block[2] = 0x1F;
+	block[4] = 0xE4;
+
+	TEST_CHECK( d3d9_dxt_decode_block( e_d3d9_fmt_dxt1, c, block ) );
+	TEST_CHECK( c[0] == 0xFFFF0000u && c[1] == 0xFF0000FFu );
+	TEST_CHECK( c[2] == 0xFFAA0055u && c[3] == 0xFF5500AAu );
+	TEST_CHECK( c[4] == 0xFFFF0000u && c[15] == 0xFFFF0000u );
+
+	// blue & red, 3 colors & transparent black in DXT1 only
+	block[0] = 0x1F;
+	block[1] = 0x00;
+	block[2] = 0x00;
+	block[3] = 0xF8;
+
+	TEST_CHECK( d3d9_dxt_decode_block( e_d3d9_fmt_dxt1, c, block ) );
+	TEST_CHECK( c[0] == 0xFF0000FFu && c[1] == 0xFFFF0000u );
+	TEST_CHECK( c[2] == 0xFF7F007Fu && c[3] == 0x00000000u );
+
+	memmove( block + 8, block, 8 );
+	memset( block, 0, 8 );
+	block[0] = 0x10; // pixel 1 at 1 / 15
+	block[7] = 0xF0; // pixel 15 opaque
+
+	TEST_CHECK( d3d9_dxt_decode_block( e_d3d9_fmt_dxt3, c, block ) );
+	TEST_CHECK( c[0] == 0x000000FFu && c[1] == 0x11FF0000u );
+	TEST_CHECK( c[2] == 0x005500AAu && c[3] == 0x00AA0055u && c[15] == 0xFF0000FFu );
+
+	// 8 alphas from 255 to 0, pixel 0 at index 2, pixel 1 at 7
+	block[0] = 255;
+	block[1] = 0;
+	block[2] = 0x3A;
+	block[3] = 0;
+	block[7] = 0;
+
+	TEST_CHECK( d3d9_dxt_decode_block( e_d3d9_fmt_dxt5, c, block ) );
+	TEST_CHECK( c[0] >> 24 == ( 6 * 255 ) / 7 && c[1] >> 24 == 255 / 7 && c[2] >> 24 == 255 );
+
+	// 6 alphas from 0 to 255, then 0 & 255
+	block[0] = 0;
+	block[1] = 255;
+	block[2] = 0xF2;
+	block[3] = 0x01;
+
+	TEST_CHECK( d3d9_dxt_decode_block( e_d3d9_fmt_dxt5, c, block ) );
+	TEST_CHECK( c[0] >> 24 == 255 / 5 && c[1] >> 24 == 0 && c[2] >> 24 == 255 && c[3] >> 24 == 0 );
+
+	TEST_CHECK( !d3d9_dxt_decode_block( e_d3d9_fmt_a8r8g8b8, c, block ) );
+	TEST_CHECK( !d3d9_dxt_encode_block( e_d3d9_fmt_a8r8g8b8, block, c ) );
+	TEST_CHECK( d3d9_dxt_block_size( e_d3d9_fmt_dxt1 ) == 8 && d3d9_dxt_block_size( e_d3d9_fmt_dxt4 ) == 16 );
+	TEST_CHECK( d3d9_dxt_block_size( e_d3d9_fmt_r5g6b5 ) == 0 );
+}
+
+//! Largest difference of a channel of two colors
+static u32 test_channel_error( d3d9_color_t a, d3d9_color_t b, u32 shift )
+{
+	s32 d = (s32)( a >> shift & 255 ) - (s32)( b >> shift & 255 );
+
+	return (u32)( d < 0 ? -d : d );
+}
+
+//! Encodes blocks of solid colors & random alphas
+static void test_dxt_blocks( void )
+{
+	static const d3d9_format_t formats[] = { e_d3d9_fmt_dxt1, e_d3d9_fmt_dxt3, e_d3d9_fmt_dxt5 };
+	u32                        seed      = 11;
+	u32                        worst[4]  = { 0, 0, 0, 0 };
+	u32                        bad       = 0;
+	u32                        n;
+	u32                        k;
+	u32                        i;
+
+	for ( n = 0; n < 4096; n++ )
+	{
+		d3d9_color_t in[16];
+		d3d9_color_t out[16];
+		u08          block[16];
+		u32          lo    = 255;
+		u32          hi    = 0;
+		u32          color = test_rand( & seed );
+
+		// a solid color, the alphas random, or two of them in DXT5
+		for ( i = 0; i < 16; i++ )
+		{
+			u32 a = n & 1 ? ( i & 4 ? 200 : 13 ) : test_rand( & seed ) & 255;
+
+			in[i] = a << 24 | color;
+			lo    = a < lo ? a : lo;
+			hi    = a > hi ? a : hi;
+		}
+
+		for ( k = 0; k < 3; k++ )
+		{
+			d3d9_color_t first = ~0u;
+
+			d3d9_dxt_encode_block( formats[k], block, in );
+			d3d9_dxt_decode_block( formats[k], out, block );
+
+			for ( i = 0; i < 16; i++ )
+			{
+				u32 a   = in[i] >> 24;
+				u32 err = test_channel_error( in[i], out[i], 24 );
+				u32 s;
+
+				// DXT1 pixels are transparent black, or opaque
+				if ( k == 0 && a < 128 )
+				{
+					bad += out[i] != 0;
+					continue;
+				}
+
+				// the color within a step of R5G6B5, the same in each pixel
+				for ( s = 0; s < 24; s += 8 )
+				{
+					u32 e = test_channel_error( in[i], out[i], s );
+
+					bad      += e > ( s == 8 ? 2u : 4u );
+					worst[3]  = e > worst[3] ? e : worst[3];
+				}
+
+				first  = first == ~0u ? out[i] & 0xFFFFFF : first;
+				bad   += ( out[i] & 0xFFFFFF ) != first;
+
+				if ( k == 0 )
+				{
+					bad += out[i] >> 24 != 255;
+				}
+				else if ( k == 1 )
+				{
+					bad += err > 8;
+				}
+				else if ( n & 1 )
+				{
+					bad += err != 0;
+				}
+				else
+				{
+					bad += err > ( hi - lo ) / 14 + 1;
+				}
+
+				worst[k] = err > worst[k] ? err : worst[k];
+			}
+		}
+	}
+
+	TEST_CHECK( bad == 0 );
+
+	printf( "conv: 4096 solid blocks, worst color error %u, worst alpha error DXT3 %u, DXT5 %u\n",
+		worst[3], worst[1], worst[2] );
+}
+
+//! Encodes & decodes gradients & noise, checking the error
+static void test_dxt_images( u32 threads )
+{
+	static const f64 bounds[2][2] = { { 2.0, 1.0 }, { 10.0, 2.0 } };
+	d3d9_parallel_t  par          = test_parallel( threads );
+	test_image_t     src;
+	u32              fi;
+	u32              kind;
+
+	// bounds is the RMSE of the color, and of the alpha of DXT4 / DXT5
+
+	for ( kind = 0; kind < 2; kind++ )
+	{
+		u32 seed = 5;
+		u32 x;
+		u32 y;
+
+		test_image( & src, e_d3d9_fmt_a8r8g8b8, 256, 256, 0, hf_false );
+
+		// a smooth gradient, or one with noise of +-16 in each channel
+		for ( y = 0; y < 256; y++ )
+		{
+			for ( x = 0; x < 256; x++ )
+			{
+				u32 c = ( ( x * y ) >> 8 ) << 24 | x << 16 | y << 8 | ( ( x + y ) >> 1 );
+				u32 i;
+
+				for ( i = 0; i < 32 && kind; i += 8 )
+				{
+					s32 v = (s32)( c >> i & 255 ) + (s32)( test_rand( & seed ) & 31 ) - 16;
+
+					v  = v < 0 ? 0 : v > 255 ? 255 : v;
+					c  = ( c & ~( 255u << i ) ) | (u32) v << i;
+				}
+
+				memcpy( test_pixel( & src, x, y ), & c, 4 );
+			}
+		}
+
+		for ( fi = 0; fi < TEST_FORMATS; fi++ )
+		{
+			const test_format_t * f = & g_test_formats[ fi ];
+			test_image_t          dxt;
+			test_image_t          out;
+			f64                   sum[2] = { 0.0, 0.0 };
+			f64                   rmse[2];
+			u32                   opaque = 0;
+			u32                   bad    = 0;
+
+			if ( f->kind != e_test_dxt )
+			{
+				continue;
+			}
+
+			test_convert( & dxt, & src, f->format, hf_false, & par );
+			test_convert( & out, & dxt, e_d3d9_fmt_a8r8g8b8, hf_false, & par );
+
+			for ( y = 0; y < 256; y++ )
+			{
+				for ( x = 0; x < 256; x++ )
+				{
+					d3d9_color_t a;
+					d3d9_color_t b;
+					u32          i;
+
+					memcpy( & a, test_pixel( & src, x, y ), 4 );
+					memcpy( & b, test_pixel( & out, x, y ), 4 );
+
+					// DXT1 keeps the color of the opaque pixels only
+					if ( f->format == e_d3d9_fmt_dxt1 )
+					{
+						bad += a >> 24 < 128 ? b != 0 : b >> 24 != 255;
+
+						if ( a >> 24 < 128 )
+						{
+							continue;
+						}
+
+						a |= 0xFF000000u;
+					}
+
+					for ( i = 0; i < 24; i += 8 )
+					{
+						sum[0] += (f64) test_channel_error( a, b, i ) * test_channel_error( a, b, i );
+					}
+
+					sum[1] += (f64) test_channel_error( a, b, 24 ) * test_channel_error( a, b, 24 );
+					opaque++;
+				}
+			}
+
+			rmse[0] = sqrt( sum[0] / ( 3 * opaque ) );
+			rmse[1] = sqrt( sum[1] / opaque );
+
+			printf( "conv: %s %-8s RMSE color %5.2f, alpha %5.2f\n",
+				d3d9_fmt_string( f->format ), kind ? "noise" : "gradient", rmse[0], rmse[1] );
+
+			// 4 bits of explicit alpha are within 17 / 2
+			TEST_CHECK( bad == 0 );
+			TEST_CHECK( rmse[0] < bounds[ kind ][0] );
+			TEST_CHECK( rmse[1] < ( f->format == e_d3d9_fmt_dxt2 || f->format == e_d3d9_fmt_dxt3 ? 5.0 : bounds[ kind ][1] ) );
+
+			test_image_free( & out );
+			test_image_free( & dxt );
+		}
+
+		test_image_free( & src );
+	}
+}
+
+//! Prints the MB/s of a few pairs, of the source read
+static void test_bench( u32 size, u32 threads )
+{
+	static const d3d9_format_t pairs[][2] =
+	{
+		{ e_d3d9_fmt_a8r8g8b8,      e_d3d9_fmt_x8b8g8r8      },
+		{ e_d3d9_fmt_a8r8g8b8,      e_d3d9_fmt_r5g6b5        },
+		{ e_d3d9_fmt_r5g6b5,        e_d3d9_fmt_a8r8g8b8      },
+		{ e_d3d9_fmt_a8r8g8b8,      e_d3d9_fmt_a4r4g4b4      },
+		{ e_d3d9_fmt_A8L8,          e_d3d9_fmt_a8r8g8b8      },
+		{ e_d3d9_fmt_a8r8g8b8,      e_d3d9_fmt_a2r10g10b10   },
+		{ e_d3d9_fmt_a16b16g16r16f, e_d3d9_fmt_a32b32g32r32f },
+		{ e_d3d9_fmt_a32b32g32r32f, e_d3d9_fmt_a16b16g16r16f },
+		{ e_d3d9_fmt_a8r8g8b8,      e_d3d9_fmt_a16b16g16r16f },
+		{ e_d3d9_fmt_a8r8g8b8,      e_d3d9_fmt_dxt1          },
+		{ e_d3d9_fmt_dxt5,          e_d3d9_fmt_a8r8g8b8      },
+	};
+	d3d9_parallel_t par = test_parallel( threads );
+	u32             isa = d3d9_conv_isa();
+	u32             p;
+	u32             i;
+	u32             r;
+
+	for ( p = 0; p < sizeof( pairs ) / sizeof( pairs[0] ); p++ )
+	{
+		test_image_t src;
+		test_image_t dst;
+
+		test_image( & src, pairs[p][0], size, size, 0, hf_false );
+		test_image( & dst, pairs[p][1], size, size, 0, hf_false );
+		test_fill( & src, p );
+
+		printf( "conv: %-14s to %-14s MB/s", d3d9_fmt_string( pairs[p][0] ), d3d9_fmt_string( pairs[p][1] ) );
+
+		for ( i = 0; i <= isa + 1; i++ )
+		{
+			u64 best = ~(u64) 0;
+
+			d3d9_conv_set_isa( i <= isa ? i : isa );
+
+			for ( r = 0; r < 5; r++ )
+			{
+				u64 t = d3d9_ticks();
+
+				d3d9_conv_image( & dst.image, & src.image, i <= isa ? nullp : & par );
+
+				t    = d3d9_ticks() - t;
+				best = t < best ? t : best;
+			}
+
+			printf( " %s %6.0f", i <= isa ? g_test_isa[i] : "threads", src.size / 1000.0 / test_ms( best ) );
+		}
+
+		printf( "\n" );
+
+		test_image_free( & dst );
+		test_image_free( & src );
+	}
+
+	d3d9_conv_set_isa( isa );
+
+	printf( "conv: %ux%u images, best of 5, on %u threads\n", size, size, threads );
+}
+
+int main( int argc, char ** argv )
+{
+	u32 size    = test_arg( argc, argv, 1, 1024 );
+	u32 threads = test_arg( argc, argv, 2, 4 );
+
+	test_reference();
+	test_halves();
+	test_pairs( threads );
+	test_levels( threads );
+	test_dxt_known();
+	test_dxt_blocks();
+	test_dxt_images( threads );
+	test_bench( size, threads );
+
+	return test_done( "conv" );
+}
@@ -0,0 +1,581 @@
+/*
+ * draw.c : Tests & Benchmark Of D3D9DRAW.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * A scene of random draws, opaque & translucent, of 60 materials & 500
+ * meshes is pushed in traversal order, sorted & submitted to a device in
+ * front of the null device. The device keeps the state the submit sets
+ * and expands every draw call into its instances, reading the instance
+ * data from the ring buffer: each instance carries the index of the draw
+ * it was pushed as, so every draw must come out once, with its own state,
+ * in the order of its sort key.
+ *
+ * Also checks that the sort split over threads gives the same order as
+ * the serial one, and times the push, sort & submit of 10k, 100k & 1M
+ * draws against the state changes of submitting them unsorted.
+ *
+ *    draw [threads] [largest scene]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9DRAW.H"
+#include "D3D9FWD.H"
+#include "D3D9NULL.H"
+#include "TEST.H"
+
+//! Size of the instance data of a draw
+#define TEST_INSTANCE 16
+
+//! A device checking the draws of a queue
+typedef struct TEST_DEVICE_T
+{
+	d3d9_fwd_device_t           fwd       ;//!< Forwards to the null device, must be first
+	d3d9_vertex_shader_t      * vs        ;//!< Vertex shader
+	d3d9_pixel_shader_t       * ps        ;//!< Pixel shader
+	d3d9_vertex_declaration_t * decl      ;//!< Vertex declaration
+	d3d9_base_texture_t       * texture[ D3D9_DRAW_TEXTURES ];//!< Stages
+	d3d9_vertex_buffer_t      * vb[2]     ;//!< Streams 0 & 1
+	u32                         offset[2] ;//!< Offsets of the streams
+	u32                         stride[2] ;//!< Strides of the streams
+	u32                         freq[2]   ;//!< Frequencies of the streams
+	d3d9_index_buffer_t       * ib        ;//!< Indices
+	const d3d9_draw_t         * draws     ;//!< The draws pushed
+	const u32                 * layers    ;//!< Their layers
+	const f32                 * depths    ;//!< Their depths
+	u08                       * seen      ;//!< Times each draw came out
+	u32                         count     ;//!< Number of draws pushed
+	u64                         key       ;//!< Key of the last draw out
+	u32                         last      ;//!< Index of the last draw out
+	u32                         out       ;//!< Draws out so far
+	u32                         calls     ;//!< Draw calls so far
+}
+test_device_t; //!< A device checking the draws of a queue
+
+//! The draws of a scene
+typedef struct TEST_SCENE_T
+{
+	d3d9_draw_t * draws  ;//!< Draws, in traversal order
+	u32         * layers ;//!< Layer of each draw
+	f32         * depths ;//!< Depth of each draw
+	u32         * data   ;//!< Instance data of each draw
+	u32           count  ;//!< Number of draws
+}
+test_scene_t; //!< The draws of a scene
+
+//! Get the address an object number stands for, nullp for 0
+#define TEST_OBJECT( T, n ) ( (n) ? (T *)(hf_addr)( 0x10000u + (n) * 64u ) : (T *) nullp )
+
+//! The test device of a device
+#define TEST_DEVICE( p ) ( (test_device_t *)( p ) )
+
+
+/****************************************************************************
+ * Checking device
+ ****************************************************************************/
+
+static hresult_t __stdcall test_set_vertex_shader( d3d9_device_t * p, d3d9_vertex_shader_t * pShader )
+{
+	TEST_DEVICE( p )->vs = pShader;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_pixel_shader( d3d9_device_t * p, d3d9_pixel_shader_t * pShader )
+{
+	TEST_DEVICE( p )->ps = pShader;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_vertex_declaration(
+	d3d9_device_t * p, d3d9_vertex_declaration_t * pDecl )
+{
+	TEST_DEVICE( p )->decl = pDecl;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_texture( d3d9_device_t * p, u32 aStage, d3d9_base_texture_t * pTexture )
+{
+	TEST_CHECK( aStage < D3D9_DRAW_TEXTURES );
+
+	TEST_DEVICE( p )->texture[ aStage % D3D9_DRAW_TEXTURES ] = pTexture;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_stream_source(
+	d3d9_device_t * p, u32 streamNumber, d3d9_vertex_buffer_t * pStreamData,
+	u32 offsetInBytes, u32 aStride )
+{
+	TEST_CHECK( streamNumber < 2 );
+
+	TEST_DEVICE( p )->vb[ streamNumber & 1 ]     = pStreamData;
+	TEST_DEVICE( p )->offset[ streamNumber & 1 ] = offsetInBytes;
+	TEST_DEVICE( p )->stride[ streamNumber & 1 ] = aStride;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_stream_source_freq( d3d9_device_t * p, u32 aStreamNumber, u32 aSetting )
+{
+	TEST_CHECK( aStreamNumber < 2 );
+
+	TEST_DEVICE( p )->freq[ aStreamNumber & 1 ] = aSetting;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_indices( d3d9_device_t * p, d3d9_index_buffer_t * pIndexData )
+{
+	TEST_DEVICE( p )->ib = pIndexData;
+
+	return D3D9_OK;
+}
+
+//! Checks the instances of a draw call against the draws they stand for
+static void test_draw( test_device_t * dev, hbool indexed, d3d9_primitivetype_t type, s32 base,
+	u32 minIndex, u32 numVertices, u32 startIndex, u32 primCount )
+{
+	d3d9_vertex_buffer_t * vb    = dev->vb[1];
+	u32                    count = 1;
+	u08                  * bits  = nullp;
+	u32                    i;
+	u32                    k;
+
+	dev->calls++;
+
+	if ( dev->freq[0] & D3D9_STREAMSOURCE_INDEXEDDATA )
+	{
+		TEST_CHECK( indexed && dev->freq[1] == ( D3D9_STREAMSOURCE_INSTANCEDATA | 1u ) );
+		TEST_CHECK( dev->stride[1] == TEST_INSTANCE );
+
+		count = dev->freq[0] & 0xffffu;
+	}
+	else
+	{
+		TEST_CHECK( dev->stride[1] == 0 );
+	}
+
+	if ( !vb || D3D9_Failed( vb->vtbl->lock( vb, 0, 0, (void **) & bits, D3D9_LOCK_READONLY ) ) )
+	{
+		TEST_CHECK( !"instance data not bound" );
+
+		return;
+	}
+
+	for ( i = 0; i < count; i++ )
+	{
+		const u32         * data = (const u32 *)( bits + dev->offset[1] + i * dev->stride[1] );
+		const d3d9_draw_t * w;
+		u32                 index = data[0];
+		u64                 key;
+
+		if ( index >= dev->count || data[1] != ~index )
+		{
+			TEST_CHECK( !"bad instance data" );
+
+			continue;
+		}
+
+		w = & dev->draws[ index ];
+
+		TEST_CHECK( dev->seen[ index ]++ == 0 );
+
+		TEST_CHECK( dev->vs == w->vs && dev->ps == w->ps && dev->decl == w->decl );
+
+		for ( k = 0; k < D3D9_DRAW_TEXTURES; k++ )
+		{
+			TEST_CHECK( dev->texture[k] == w->texture[k] );
+		}
+
+		TEST_CHECK( dev->vb[0] == w->vb && dev->offset[0] == w->offset && dev->stride[0] == w->stride );
+		TEST_CHECK( indexed == ( w->ib != nullp ) && ( !indexed || dev->ib == w->ib ) );
+		TEST_CHECK( type == w->type && base == w->baseVertex && primCount == w->primCount );
+		TEST_CHECK( !indexed || ( minIndex == w->minIndex && numVertices == w->numVertices
+		                       && startIndex == w->startIndex ) );
+
+		// in key order, and in push order among equal keys
+		key = d3d9_draw_key( w, dev->layers[ index ], dev->depths[ index ] );
+
+		TEST_CHECK( dev->out == 0 || dev->key < key || ( dev->key == key && dev->last < index ) );
+
+		dev->key  = key;
+		dev->last = index;
+		dev->out++;
+	}
+
+	vb->vtbl->unlock( vb );
+}
+
+static hresult_t __stdcall test_draw_indexed_primitive(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, int baseVertexIndex,
+	u32 minVertexIndex, u32 numVertices, u32 startIndex, u32 primCount )
+{
+	d3d9_device_t * t = TEST_DEVICE( p )->fwd.target;
+
+	test_draw( TEST_DEVICE( p ), hf_true, primitiveType, baseVertexIndex,
+		minVertexIndex, numVertices, startIndex, primCount );
+
+	return t->vtbl->drawIndexedPrimitive( t, primitiveType, baseVertexIndex,
+		minVertexIndex, numVertices, startIndex, primCount );
+}
+
+static hresult_t __stdcall test_draw_primitive(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, u32 startVertex, u32 primitiveCount )
+{
+	d3d9_device_t * t = TEST_DEVICE( p )->fwd.target;
+
+	test_draw( TEST_DEVICE( p ), hf_false, primitiveType, (s32) startVertex, 0, 0, 0, primitiveCount );
+
+	return t->vtbl->drawPrimitive( t, primitiveType, startVertex, primitiveCount );
+}
+
+//! Creates a checking device in front of a null device
+static d3d9_device_t * test_device_create( test_device_t * dev )
+{
+	d3d9_device_t      * null = d3d9_null_device_create( nullp );
+	d3d9_device_vtbl_t * v    = & dev->fwd.vtbl;
+
+	memset( dev, 0, sizeof( test_device_t ) );
+
+	d3d9_fwd_device_init( & dev->fwd, null, nullp );
+
+	null->vtbl->release( null );
+
+	v->setVertexShader      = test_set_vertex_shader;
+	v->setPixelShader       = test_set_pixel_shader;
+	v->setVertexDeclaration = test_set_vertex_declaration;
+	v->setTexture           = test_set_texture;
+	v->setStreamSource      = test_set_stream_source;
+	v->setStreamSourceFreq  = test_set_stream_source_freq;
+	v->setIndices           = test_set_indices;
+	v->drawIndexedPrimitive = test_draw_indexed_primitive;
+	v->drawPrimitive        = test_draw_primitive;
+
+	return & dev->fwd.device;
+}
+
+//! Starts checking the submit of a scene
+static void test_device_begin( test_device_t * dev, const test_scene_t * s )
+{
+	memset( dev->texture, 0, sizeof( dev->texture ) );
+
+	dev->freq[0] = 1;
+	dev->freq[1] = 1;
+	dev->draws   = s->draws;
+	dev->layers  = s->layers;
+	dev->depths  = s->depths;
+	dev->count   = s->count;
+	dev->seen    = (u08 *) calloc( s->count, 1 );
+	dev->out     = 0;
+	dev->calls   = 0;
+}
+
+//! Checks every draw came out once
+static void test_device_end( test_device_t * dev )
+{
+	u32 i;
+
+	TEST_CHECK( dev->out == dev->count );
+	TEST_CHECK( dev->freq[0] == 1 && dev->freq[1] == 1 );
+
+	for ( i = 0; i < dev->count; i++ )
+	{
+		if ( dev->seen[i] != 1 )
+		{
+			TEST_CHECK( !"draw dropped or repeated" );
+
+			break;
+		}
+	}
+
+	free( dev->seen );
+}
+
+
+/****************************************************************************
+ * Scenes
+ ****************************************************************************/
+
+//! Makes a scene of @p count draws
+static void test_scene( test_scene_t * s, u32 count )
+{
+	u32 seed = 7;
+	u32 i;
+
+	s->draws  = (d3d9_draw_t *) calloc( count, sizeof( d3d9_draw_t ) );
+	s->layers = (u32 *) malloc( count * sizeof( u32 ) );
+	s->depths = (f32 *) malloc( count * sizeof( f32 ) );
+	s->data   = (u32 *) malloc( count * TEST_INSTANCE );
+	s->count  = count;
+
+	for ( i = 0; i < count; i++ )
+	{
+		d3d9_draw_t * w        = & s->draws[i];
+		u32           mesh     = test_rand( & seed ) % 500;
+		u32           material = test_rand( & seed ) % 60;
+
+		w->vs          = TEST_OBJECT( d3d9_vertex_shader_t, 1 + material % 8 );
+		w->ps          = TEST_OBJECT( d3d9_pixel_shader_t, 20 + material % 16 );
+		w->decl        = TEST_OBJECT( d3d9_vertex_declaration_t, 40 + mesh % 4 );
+		w->texture[0]  = TEST_OBJECT( d3d9_base_texture_t, 100 + material );
+		w->texture[1]  = TEST_OBJECT( d3d9_base_texture_t, material % 3 ? 200 + material % 5 : 0 );
+		w->vb          = TEST_OBJECT( d3d9_vertex_buffer_t, 1000 + mesh / 4 );
+		w->ib          = TEST_OBJECT( d3d9_index_buffer_t, mesh % 10 ? 2000 + mesh / 4 : 0 );
+		w->offset      = ( mesh % 2 ) * 4096;
+		w->stride      = 32;
+		w->type        = e_d3d9_pt_trianglelist;
+		w->baseVertex  = (s32)( mesh % 4 ) * 100;
+		w->minIndex    = 0;
+		w->numVertices = 100 + mesh % 50;
+		w->startIndex  = ( mesh % 4 ) * 300;
+		w->primCount   = ( 20 + mesh % 80 ) >> ( test_rand( & seed ) % 4 == 0 ); // a lower LOD
+
+		w->instance       = & s->data[ i * TEST_INSTANCE / 4 ];
+		w->instanceStride = TEST_INSTANCE;
+
+		s->data[ i * TEST_INSTANCE / 4 + 0 ] = i;
+		s->data[ i * TEST_INSTANCE / 4 + 1 ] = ~i;
+		s->data[ i * TEST_INSTANCE / 4 + 2 ] = mesh;
+		s->data[ i * TEST_INSTANCE / 4 + 3 ] = material;
+
+		s->layers[i] = test_rand( & seed ) % 10 ? material % 4 : D3D9_DRAW_LAYER_SORTED + 1;
+		s->depths[i] = (f32)( test_rand( & seed ) % 10000 ) / 10000.0f;
+	}
+}
+
+//! Frees a scene
+static void test_scene_free( test_scene_t * s )
+{
+	free( s->draws );
+	free( s->layers );
+	free( s->depths );
+	free( s->data );
+}
+
+//! Counts the state changes of submitting a scene unsorted, one call each
+static u32 test_unsorted_states( const test_scene_t * s )
+{
+	const d3d9_draw_t * prev   = nullp;
+	u32                 states = 0;
+	u32                 i;
+	u32                 k;
+
+	for ( i = 0; i < s->count; prev = & s->draws[ i++ ] )
+	{
+		const d3d9_draw_t * w = & s->draws[i];
+
+		if ( !prev )
+		{
+			states += 5 + D3D9_DRAW_TEXTURES + ( w->ib != nullp );
+
+			continue;
+		}
+
+		states += ( w->vs != prev->vs ) + ( w->ps != prev->ps ) + ( w->decl != prev->decl );
+		states += w->vb != prev->vb || w->offset != prev->offset || w->stride != prev->stride;
+		states += w->ib && w->ib != prev->ib;
+		states += 1; // the instance data
+
+		for ( k = 0; k < D3D9_DRAW_TEXTURES; k++ )
+		{
+			states += w->texture[k] != prev->texture[k];
+		}
+	}
+
+	return states;
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! Pushes, sorts & submits a scene, checking the draws which come out
+static void test_submit( const test_scene_t * s, hbool instancing, u32 threads )
+{
+	test_device_t      dev;
+	d3d9_device_t    * d   = test_device_create( & dev );
+	d3d9_parallel_t    par = test_parallel( threads );
+	d3d9_drawq_t       q;
+	d3d9_ring_t        ring;
+	d3d9_null_stats_t  stats;
+	d3d9_draw_item_t * serial;
+	u64                t0;
+	u64                t1;
+	u64                t2;
+	u64                t3;
+	u64                t4;
+	u32                i;
+
+	TEST_CHECK( d3d9_drawq_init( & q, s->count, instancing ) );
+	TEST_CHECK( d3d9_ring_init_vertex( & ring, d, 1 << 20 ) == D3D9_OK );
+	TEST_CHECK( d3d9_ring_begin_frame( & ring, 1 ) );
+
+	t0 = d3d9_ticks();
+
+	for ( i = 0; i < s->count; i++ )
+	{
+		d3d9_drawq_push( & q, & s->draws[i], s->layers[i], s->depths[i] );
+	}
+
+	t1 = d3d9_ticks();
+	d3d9_drawq_sort( & q, nullp );
+	t2 = d3d9_ticks();
+
+	TEST_CHECK( q.count == s->count && q.stats.overflow == 0 );
+
+	serial = (d3d9_draw_item_t *) malloc( s->count * sizeof( d3d9_draw_item_t ) );
+	memcpy( serial, q.items, s->count * sizeof( d3d9_draw_item_t ) );
+
+	// sort the pushed order again, over the threads
+	d3d9_drawq_reset( & q );
+
+	for ( i = 0; i < s->count; i++ )
+	{
+		d3d9_drawq_push( & q, & s->draws[i], s->layers[i], s->depths[i] );
+	}
+
+	t3 = d3d9_ticks();
+	d3d9_drawq_sort( & q, & par );
+	t4 = d3d9_ticks();
+
+	TEST_CHECK( !memcmp( serial, q.items, s->count * sizeof( d3d9_draw_item_t ) ) );
+	free( serial );
+
+	test_device_begin( & dev, s );
+	d3d9_null_device_reset_stats( dev.fwd.target );
+
+	t4 -= t3;
+	t3  = d3d9_ticks();
+	TEST_CHECK( d3d9_drawq_submit( & q, d, & ring ) == D3D9_OK );
+	t3  = d3d9_ticks() - t3;
+
+	test_device_end( & dev );
+
+	d3d9_null_device_get_stats( dev.fwd.target, & stats );
+
+	TEST_CHECK( stats.draws == q.stats.calls && dev.calls == q.stats.calls );
+	TEST_CHECK( instancing || q.stats.calls == s->count );
+
+	printf( "draw: %7u draws, instancing %s: push %.2f ms, sort %.2f ms, on %u threads %.2f ms,"
+	        " submit %.2f ms\n", s->count, instancing ? "on " : "off", test_ms( t1 - t0 ),
+	        test_ms( t2 - t1 ), threads, test_ms( t4 ), test_ms( t3 ) );
+	printf( "draw: %7u draws, unsorted %u calls %u states, sorted %u calls (%u instanced) %u states\n",
+		s->count, s->count, test_unsorted_states( s ), q.stats.calls, q.stats.instanced, q.stats.states );
+
+	d3d9_ring_end_frame( & ring );
+	d3d9_ring_free( & ring );
+	d3d9_drawq_free( & q );
+
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+}
+
+//! A run of more instances than the ring holds comes out as several runs
+static void test_large_run( void )
+{
+	test_device_t      dev;
+	d3d9_device_t    * d = test_device_create( & dev );
+	d3d9_drawq_t       q;
+	d3d9_ring_t        ring;
+	d3d9_null_stats_t  stats;
+	test_scene_t       s;
+	u32                i;
+
+	// one mesh & material, 1000 instances of 16 bytes in a ring of 4096
+	test_scene( & s, 1000 );
+
+	for ( i = 0; i < s.count; i++ )
+	{
+		const void * instance = s.draws[i].instance;
+
+		s.draws[i]          = s.draws[0];
+		s.draws[i].ib       = TEST_OBJECT( d3d9_index_buffer_t, 2000 );
+		s.draws[i].instance = instance;
+		s.layers[i]         = 0;
+		s.depths[i]         = 0.5f;
+	}
+
+	TEST_CHECK( d3d9_drawq_init( & q, s.count, hf_true ) );
+	TEST_CHECK( d3d9_ring_init_vertex( & ring, d, 4096 ) == D3D9_OK );
+	TEST_CHECK( d3d9_ring_begin_frame( & ring, 1 ) );
+
+	for ( i = 0; i < s.count; i++ )
+	{
+		d3d9_drawq_push( & q, & s.draws[i], s.layers[i], s.depths[i] );
+	}
+
+	d3d9_drawq_sort( & q, nullp );
+
+	test_device_begin( & dev, & s );
+	d3d9_null_device_reset_stats( dev.fwd.target );
+
+	TEST_CHECK( d3d9_drawq_submit( & q, d, & ring ) == D3D9_OK );
+
+	test_device_end( & dev );
+
+	d3d9_null_device_get_stats( dev.fwd.target, & stats );
+
+	printf( "draw: %u instances in a ring of 4096 bytes, %u calls, %u discards\n",
+		s.count, q.stats.calls, ring.stats.discards );
+
+	TEST_CHECK( q.stats.calls == ( s.count + 254 ) / 255 && stats.draws == q.stats.calls );
+
+	d3d9_ring_end_frame( & ring );
+	d3d9_ring_free( & ring );
+	d3d9_drawq_free( & q );
+	test_scene_free( & s );
+
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+}
+
+//! A full queue refuses draws & counts them
+static void test_overflow( void )
+{
+	d3d9_drawq_t q;
+	d3d9_draw_t  w;
+
+	memset( & w, 0, sizeof( w ) );
+
+	TEST_CHECK( d3d9_drawq_init( & q, 2, hf_true ) );
+	TEST_CHECK( d3d9_drawq_push( & q, & w, 0, 0.5f ) );
+	TEST_CHECK( d3d9_drawq_push( & q, & w, 0, 0.5f ) );
+	TEST_CHECK( !d3d9_drawq_push( & q, & w, 0, 0.5f ) );
+	TEST_CHECK( q.count == 2 && q.stats.overflow == 1 );
+
+	d3d9_drawq_free( & q );
+}
+
+int main( int argc, char ** argv )
+{
+	u32          threads = test_arg( argc, argv, 1, 4 );
+	u32          largest = test_arg( argc, argv, 2, 1000000 );
+	test_scene_t s;
+	u32          n;
+
+	test_overflow();
+	test_large_run();
+
+	for ( n = 10000; n <= largest; n *= 10 )
+	{
+		test_scene( & s, n );
+
+		test_submit( & s, hf_true, threads );
+
+		if ( n == 10000 )
+		{
+			test_submit( & s, hf_false, threads );
+		}
+
+		test_scene_free( & s );
+	}
+
+	return test_done( "draw" );
+}
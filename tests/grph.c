@@ -0,0 +1,535 @@
+/*
+ * grph.c : Tests & Benchmark Of D3D9GRPH.H & D3D9POOL.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * The pool is checked on its own against the null device: the sizes of the
+ * keys, prewarming, hits & misses, a release given twice, the idle frames
+ * after which resources are evicted, the budget, and the objects of the
+ * device which must all be released once the pool is trimmed or freed.
+ *
+ * Then a deferred frame followed by a chain of post-processing passes (17
+ * transients in 15 passes, down to the back buffer) is declared, compiled
+ * & executed for 10 frames, with aliasing off then on. Every pass checks
+ * that all the transients alive during it, used by it or not, have
+ * surfaces of their own, and that a transient keeps its surface from its
+ * first pass to its last. The pool must create the surfaces on the first
+ * frame only, and its peak bytes, printed for both, must be those of the
+ * compilation and lower with aliasing. After a change of resolution the
+ * surfaces of the old one must age out of the pool.
+ *
+ * Also times the declaration, compilation & execution of the frame.
+ *
+ *    grph [frames]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9GRPH.H"
+#include "D3D9NULL.H"
+#include "TEST.H"
+
+//! Most resources of a test frame
+#define TEST_RESOURCES 32
+
+//! Most passes of a test frame
+#define TEST_PASSES    32
+
+//! Most resources used by a pass
+#define TEST_USES      8
+
+//! The resources a pass declared
+typedef struct TEST_PASS_T
+{
+	u32 count                ;//!< Resources used
+	u32 resources[ TEST_USES ];//!< Their indices
+}
+test_pass_t; //!< The resources a pass declared
+
+//! A frame of passes, and what they saw while executing
+typedef struct TEST_FRAME_T
+{
+	d3d9_device_t  * device                      ;//!< The null device
+	test_pass_t      passes   [ TEST_PASSES ]    ;//!< Declared passes
+	u32              first    [ TEST_RESOURCES ] ;//!< First pass of each resource
+	u32              last     [ TEST_RESOURCES ] ;//!< Last pass of each resource
+	d3d9_surface_t * surfaces [ TEST_RESOURCES ] ;//!< Surface each resource was seen with
+	u32              resources                   ;//!< Resources declared
+	u32              passCount                   ;//!< Passes declared
+	u32              back                        ;//!< The imported back buffer
+	u32              runs                        ;//!< Passes run
+}
+test_frame_t; //!< A frame of passes, and what they saw while executing
+
+
+/****************************************************************************
+ * Pool
+ ****************************************************************************/
+
+//! Acquisitions, idle frames & budget of a pool
+static void test_pool( d3d9_device_t * device )
+{
+	d3d9_respool_desc_t   desc;
+	d3d9_respool_stats_t  ps;
+	d3d9_null_stats_t     ns;
+	d3d9_respool_key_t    rt;
+	d3d9_respool_key_t    msaa;
+	d3d9_respool_key_t    tex;
+	d3d9_respool_item_t * a;
+	d3d9_respool_item_t * b;
+	d3d9_respool_t      * pool;
+
+	d3d9_respool_key_rendertarget( & rt,   640, 480, e_d3d9_fmt_a8r8g8b8 );
+	d3d9_respool_key_rendertarget( & msaa, 640, 480, e_d3d9_fmt_a8r8g8b8 );
+	d3d9_respool_key_texture( & tex, 256, 256, 0, 0, e_d3d9_fmt_a8r8g8b8, e_d3d9_pool_managed );
+
+	msaa.multiSample = 4;
+
+	TEST_CHECK( d3d9_respool_bytes( & rt )   == 640 * 480 * 4 );
+	TEST_CHECK( d3d9_respool_bytes( & msaa ) == 640 * 480 * 4 * 4 );
+	TEST_CHECK( d3d9_respool_bytes( & tex )  == 4 * ( 256 * 256 * 4 - 1 ) / 3 );
+
+	// 2 warm, a hit, a miss of another key, a release given twice
+	D3D9LDR_MEMSET( & desc, 0, sizeof( desc ) );
+
+	desc.idleFrames = 2;
+	pool            = d3d9_respool_create( device, & desc );
+
+	TEST_CHECK( d3d9_respool_prewarm( pool, & rt, 2 ) == D3D9_OK );
+
+	d3d9_respool_get_stats( pool, & ps );
+
+	TEST_CHECK( ps.items == 2 && ps.idle == 2 && ps.misses == 0 && ps.hits == 0 );
+
+	TEST_CHECK( d3d9_respool_acquire( pool, & rt,   & a ) == D3D9_OK && a->surface && !a->texture );
+	TEST_CHECK( d3d9_respool_acquire( pool, & msaa, & b ) == D3D9_OK && b->surface != a->surface );
+
+	d3d9_respool_get_stats( pool, & ps );
+
+	TEST_CHECK( ps.hits == 1 && ps.misses == 1 && ps.items == 3 && ps.idle == 1 );
+
+	d3d9_respool_release( pool, a );
+	d3d9_respool_release( pool, a );
+	d3d9_respool_release( pool, b );
+
+	d3d9_respool_get_stats( pool, & ps );
+
+	TEST_CHECK( ps.idle == 3 && ps.idleBytes == ps.bytes );
+
+	// the one acquired stays, the 2 others are evicted after 2 idle frames
+	d3d9_respool_frame( pool );
+
+	TEST_CHECK( d3d9_respool_acquire( pool, & rt, & a ) == D3D9_OK );
+
+	d3d9_respool_frame( pool );
+	d3d9_respool_get_stats( pool, & ps );
+
+	TEST_CHECK( ps.items == 1 && ps.idle == 0 && ps.evictions == 2 );
+
+	// only the textures drawn to get their level 0 as surface
+	TEST_CHECK( d3d9_respool_acquire( pool, & tex, & b ) == D3D9_OK && b->texture && !b->surface );
+
+	d3d9_respool_release( pool, a );
+	d3d9_respool_release( pool, b );
+	d3d9_respool_trim( pool, 0 );
+	d3d9_respool_get_stats( pool, & ps );
+
+	TEST_CHECK( ps.items == 0 && ps.bytes == 0 && ps.idleBytes == 0 );
+	TEST_CHECK( ps.peakBytes == d3d9_respool_bytes( & rt ) * 2 + d3d9_respool_bytes( & msaa ) );
+
+	d3d9_null_device_get_stats( device, & ns );
+
+	TEST_CHECK( ns.objects == 0 );
+
+	d3d9_respool_free( pool );
+
+	// the oldest idle ones go while above the budget
+	desc.idleFrames = 100;
+	desc.budget     = d3d9_respool_bytes( & rt ) * 2;
+	pool            = d3d9_respool_create( device, & desc );
+
+	TEST_CHECK( d3d9_respool_prewarm( pool, & rt, 4 ) == D3D9_OK );
+
+	d3d9_respool_frame( pool );
+	d3d9_respool_get_stats( pool, & ps );
+
+	TEST_CHECK( ps.items == 2 && ps.evictions == 2 && ps.bytes == desc.budget );
+	TEST_CHECK( ps.peakBytes == d3d9_respool_bytes( & rt ) * 4 );
+
+	d3d9_respool_free( pool );
+
+	d3d9_null_device_get_stats( device, & ns );
+
+	TEST_CHECK( ns.objects == 0 );
+}
+
+
+/****************************************************************************
+ * Frame
+ ****************************************************************************/
+
+//! Runs a pass: the transients alive during it must all have surfaces of their own
+static void test_pass_run( void * user, d3d9_graph_t * graph, u32 pass )
+{
+	test_frame_t      * f = (test_frame_t *) user;
+	const test_pass_t * p = & f->passes[ pass ];
+	u32                 a;
+	u32                 b;
+
+	f->runs++;
+
+	for ( a = 0; a < f->resources; a++ )
+	{
+		d3d9_surface_t * s = d3d9_graph_surface( graph, a );
+
+		if ( f->first[a] > pass || f->last[a] < pass )
+		{
+			continue;
+		}
+
+		TEST_CHECK( s != nullp );
+		TEST_CHECK( !f->surfaces[a] || f->surfaces[a] == s );
+
+		f->surfaces[a] = s;
+
+		for ( b = 0; b < a; b++ )
+		{
+			if ( f->first[b] <= pass && pass <= f->last[b] )
+			{
+				TEST_CHECK( d3d9_graph_surface( graph, b ) != s );
+			}
+		}
+	}
+
+	for ( a = 0; a < p->count; a++ )
+	{
+		TEST_CHECK( f->device->vtbl->setRenderTarget( f->device, 0, d3d9_graph_surface( graph, p->resources[a] ) ) == D3D9_OK );
+	}
+}
+
+//! Declares that a pass reads or writes a resource
+static void test_use( test_frame_t * f, d3d9_graph_t * graph, u32 pass, u32 resource, hbool write )
+{
+	test_pass_t * p = & f->passes[ pass ];
+
+	TEST_CHECK( ( write ? d3d9_graph_write( graph, pass, resource ) : d3d9_graph_read( graph, pass, resource ) ) == D3D9_OK );
+
+	p->resources[ p->count++ ] = resource;
+
+	f->first[ resource ] = f->first[ resource ] < pass ? f->first[ resource ] : pass;
+	f->last [ resource ] = f->last [ resource ] > pass ? f->last [ resource ] : pass;
+}
+
+//! Declares a pass
+static u32 test_pass( test_frame_t * f, d3d9_graph_t * graph, const char * name )
+{
+	u32 pass = d3d9_graph_pass( graph, name, test_pass_run, f );
+
+	TEST_CHECK( pass == f->passCount++ );
+
+	return pass;
+}
+
+//! Declares a deferred frame & its post-processing at @p width x @p height
+static void test_build( test_frame_t * f, d3d9_graph_t * graph, u32 width, u32 height, d3d9_surface_t * back )
+{
+	d3d9_respool_key_t hdr;
+	d3d9_respool_key_t ldr;
+	d3d9_respool_key_t depth;
+	d3d9_respool_key_t half;
+	d3d9_respool_key_t quarter;
+	d3d9_respool_key_t eighth;
+	d3d9_respool_key_t lum;
+	d3d9_device_t    * device = f->device;
+	u32                r[17];
+	u32                p;
+	u32                i;
+
+	D3D9LDR_MEMSET( f, 0, sizeof( test_frame_t ) );
+
+	f->device = device;
+
+	for ( i = 0; i < TEST_RESOURCES; i++ )
+	{
+		f->first[i] = D3D9_GRAPH_NONE;
+		f->last[i]  = 0;
+	}
+
+	d3d9_graph_reset( graph );
+
+	d3d9_respool_key_texture( & hdr,     width,     height,     1, D3D9_USAGE_RENDERTARGET, e_d3d9_fmt_a16b16g16r16f, e_d3d9_pool_default );
+	d3d9_respool_key_texture( & ldr,     width,     height,     1, D3D9_USAGE_RENDERTARGET, e_d3d9_fmt_a8r8g8b8,      e_d3d9_pool_default );
+	d3d9_respool_key_texture( & half,    width / 2, height / 2, 1, D3D9_USAGE_RENDERTARGET, e_d3d9_fmt_a16b16g16r16f, e_d3d9_pool_default );
+	d3d9_respool_key_texture( & quarter, width / 4, height / 4, 1, D3D9_USAGE_RENDERTARGET, e_d3d9_fmt_a16b16g16r16f, e_d3d9_pool_default );
+	d3d9_respool_key_texture( & eighth,  width / 8, height / 8, 1, D3D9_USAGE_RENDERTARGET, e_d3d9_fmt_a16b16g16r16f, e_d3d9_pool_default );
+	d3d9_respool_key_texture( & lum,     1,         1,          1, D3D9_USAGE_RENDERTARGET, e_d3d9_fmt_r16f,          e_d3d9_pool_default );
+	d3d9_respool_key_depthstencil( & depth, width, height, e_d3d9_fmt_d24s8 );
+
+	r[0]  = d3d9_graph_transient( graph, & depth,   "Depth" );
+	r[1]  = d3d9_graph_transient( graph, & ldr,     "Albedo" );
+	r[2]  = d3d9_graph_transient( graph, & ldr,     "Normals" );
+	r[3]  = d3d9_graph_transient( graph, & ldr,     "Specular" );
+	r[4]  = d3d9_graph_transient( graph, & hdr,     "Light" );
+	r[5]  = d3d9_graph_transient( graph, & ldr,     "SSAO" );
+	r[6]  = d3d9_graph_transient( graph, & ldr,     "SSAO blurred" );
+	r[7]  = d3d9_graph_transient( graph, & half,    "Half" );
+	r[8]  = d3d9_graph_transient( graph, & quarter, "Quarter" );
+	r[9]  = d3d9_graph_transient( graph, & eighth,  "Eighth" );
+	r[10] = d3d9_graph_transient( graph, & eighth,  "Eighth blurred" );
+	r[11] = d3d9_graph_transient( graph, & quarter, "Quarter up" );
+	r[12] = d3d9_graph_transient( graph, & half,    "Half up" );
+	r[13] = d3d9_graph_transient( graph, & lum,     "Luminance" );
+	r[14] = d3d9_graph_transient( graph, & hdr,     "Depth of field" );
+	r[15] = d3d9_graph_transient( graph, & ldr,     "Tone mapped" );
+	r[16] = d3d9_graph_transient( graph, & ldr,     "FXAA" );
+	f->back = d3d9_graph_import( graph, nullp, back, "Back buffer" );
+
+	for ( i = 0; i < 17; i++ )
+	{
+		TEST_CHECK( r[i] == i );
+	}
+
+	f->resources = f->back + 1;
+
+	p = test_pass( f, graph, "G-buffer" );
+	test_use( f, graph, p, r[0], hf_true );
+	test_use( f, graph, p, r[1], hf_true );
+	test_use( f, graph, p, r[2], hf_true );
+	test_use( f, graph, p, r[3], hf_true );
+
+	p = test_pass( f, graph, "SSAO" );
+	test_use( f, graph, p, r[0], hf_false );
+	test_use( f, graph, p, r[2], hf_false );
+	test_use( f, graph, p, r[5], hf_true );
+
+	p = test_pass( f, graph, "SSAO blur" );
+	test_use( f, graph, p, r[5], hf_false );
+	test_use( f, graph, p, r[6], hf_true );
+
+	p = test_pass( f, graph, "Lighting" );
+	test_use( f, graph, p, r[0], hf_false );
+	test_use( f, graph, p, r[1], hf_false );
+	test_use( f, graph, p, r[2], hf_false );
+	test_use( f, graph, p, r[3], hf_false );
+	test_use( f, graph, p, r[6], hf_false );
+	test_use( f, graph, p, r[4], hf_true );
+
+	// the bloom chain, down to an eighth & back up
+	for ( i = 0; i < 6; i++ )
+	{
+		static const char * names[] = { "Down 2", "Down 4", "Down 8", "Blur 8", "Up 4", "Up 2" };
+
+		p = test_pass( f, graph, names[i] );
+		test_use( f, graph, p, i ? r[ 6 + i ] : r[4], hf_false );
+		test_use( f, graph, p, r[ 7 + i ], hf_true );
+	}
+
+	p = test_pass( f, graph, "Luminance" );
+	test_use( f, graph, p, r[12], hf_false );
+	test_use( f, graph, p, r[13], hf_true );
+
+	p = test_pass( f, graph, "Depth of field" );
+	test_use( f, graph, p, r[4], hf_false );
+	test_use( f, graph, p, r[0], hf_false );
+	test_use( f, graph, p, r[14], hf_true );
+
+	p = test_pass( f, graph, "Tone map" );
+	test_use( f, graph, p, r[14], hf_false );
+	test_use( f, graph, p, r[12], hf_false );
+	test_use( f, graph, p, r[13], hf_false );
+	test_use( f, graph, p, r[15], hf_true );
+
+	p = test_pass( f, graph, "FXAA" );
+	test_use( f, graph, p, r[15], hf_false );
+	test_use( f, graph, p, r[16], hf_true );
+
+	p = test_pass( f, graph, "Present" );
+	test_use( f, graph, p, r[16], hf_false );
+	test_use( f, graph, p, f->back, hf_true );
+}
+
+//! Get the number of different surfaces the transients were seen with
+static u32 test_surfaces( const test_frame_t * f )
+{
+	u32 count = 0;
+	u32 a;
+	u32 b;
+
+	for ( a = 0; a < f->back; a++ )
+	{
+		for ( b = 0; b < a && f->surfaces[b] != f->surfaces[a]; b++ )
+		{
+		}
+
+		count += b == a;
+	}
+
+	return count;
+}
+
+//! Compiles & executes a frame
+static void test_frame( test_frame_t * f, d3d9_graph_t * graph, hbool alias )
+{
+	TEST_CHECK( d3d9_graph_compile( graph, alias ) == D3D9_OK );
+
+	f->runs = 0;
+
+	TEST_CHECK( d3d9_graph_execute( graph ) == D3D9_OK );
+	TEST_CHECK( f->runs == f->passCount );
+	TEST_CHECK( f->surfaces[ f->back ] != nullp );
+}
+
+//! 10 frames with aliasing off, then on, and a change of resolution
+static void test_aliasing( d3d9_device_t * device, d3d9_surface_t * back )
+{
+	d3d9_respool_stats_t ps;
+	d3d9_graph_stats_t   gs;
+	d3d9_null_stats_t    ns;
+	test_frame_t         f;
+	d3d9_respool_t     * pool;
+	d3d9_graph_t       * graph;
+	u64                  peak[2];
+	u32                  alias;
+	u32                  i;
+
+	f.device = device;
+
+	for ( alias = 0; alias < 2; alias++ )
+	{
+		pool  = d3d9_respool_create( device, nullp );
+		graph = d3d9_graph_create( pool );
+
+		for ( i = 0; i < 10; i++ )
+		{
+			test_build( & f, graph, 1920, 1080, back );
+			test_frame( & f, graph, (hbool) alias );
+
+			TEST_CHECK( f.surfaces[ f.back ] == back );
+
+			d3d9_respool_frame( pool );
+		}
+
+		d3d9_graph_get_stats( graph, & gs );
+		d3d9_respool_get_stats( pool, & ps );
+
+		printf( "grph: aliasing %-3s %u passes, %u transients on %u surfaces (%u seen), "
+		        "%.1f MB, peak %.1f MB, at most %.1f MB alive in a pass, %u created in 10 frames\n",
+			alias ? "on," : "off,", gs.passes, gs.transients, gs.slots, test_surfaces( & f ),
+			gs.bytes / 1048576.0, ps.peakBytes / 1048576.0, gs.liveBytes / 1048576.0, ps.misses );
+
+		TEST_CHECK( gs.passes == 15 && gs.transients == 17 && test_surfaces( & f ) == gs.slots );
+		TEST_CHECK( ps.misses == gs.slots && ps.hits == gs.slots * 9 && ps.items == gs.slots );
+		TEST_CHECK( ps.peakBytes == gs.aliasedBytes && gs.aliasedBytes >= gs.liveBytes );
+		TEST_CHECK( alias || gs.aliasedBytes == gs.bytes );
+
+		peak[ alias ] = ps.peakBytes;
+
+		// the surfaces of 1080p age out of the pool
+		for ( i = 0; i < 5; i++ )
+		{
+			test_build( & f, graph, 1280, 720, back );
+			test_frame( & f, graph, (hbool) alias );
+
+			d3d9_respool_frame( pool );
+		}
+
+		d3d9_graph_get_stats( graph, & gs );
+		d3d9_respool_get_stats( pool, & ps );
+
+		TEST_CHECK( ps.items == gs.slots && ps.idle == gs.slots );
+
+		d3d9_graph_free( graph );
+		d3d9_respool_free( pool );
+
+		d3d9_null_device_get_stats( device, & ns );
+
+		TEST_CHECK( ns.objects == 0 );
+	}
+
+	TEST_CHECK( peak[1] < peak[0] );
+}
+
+//! A transient read before it's written, & wrong indices
+static void test_invalid( d3d9_device_t * device )
+{
+	d3d9_respool_key_t   key;
+	d3d9_respool_t     * pool  = d3d9_respool_create( device, nullp );
+	d3d9_graph_t       * graph = d3d9_graph_create( pool );
+	u32                  r;
+	u32                  a;
+	u32                  b;
+
+	d3d9_respool_key_rendertarget( & key, 64, 64, e_d3d9_fmt_a8r8g8b8 );
+
+	r = d3d9_graph_transient( graph, & key, "Read first" );
+	a = d3d9_graph_pass( graph, "Reads", nullp, nullp );
+	b = d3d9_graph_pass( graph, "Writes", nullp, nullp );
+
+	TEST_CHECK( d3d9_graph_execute( graph ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_graph_read ( graph, a, r ) == D3D9_OK );
+	TEST_CHECK( d3d9_graph_write( graph, b, r ) == D3D9_OK );
+	TEST_CHECK( d3d9_graph_read ( graph, 7, r ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_graph_write( graph, a, 7 ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_graph_compile( graph, hf_true ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_graph_execute( graph ) == D3D9_ERR_INVALIDCALL );
+
+	d3d9_graph_free( graph );
+	d3d9_respool_free( pool );
+}
+
+//! Times the declaration, compilation & execution of the frame
+static void test_benchmark( d3d9_device_t * device, d3d9_surface_t * back, u32 frames )
+{
+	d3d9_respool_stats_t ps;
+	test_frame_t         f;
+	d3d9_respool_t     * pool  = d3d9_respool_create( device, nullp );
+	d3d9_graph_t       * graph = d3d9_graph_create( pool );
+	u64                  ticks = d3d9_ticks();
+	u32                  i;
+
+	f.device = device;
+
+	for ( i = 0; i < frames; i++ )
+	{
+		test_build( & f, graph, 1920, 1080, back );
+		test_frame( & f, graph, hf_true );
+
+		d3d9_respool_frame( pool );
+	}
+
+	ticks = d3d9_ticks() - ticks;
+
+	d3d9_respool_get_stats( pool, & ps );
+
+	printf( "grph: %u frames of 15 passes, %.2f us per frame, %u created, %u reused\n",
+		frames, test_ms( ticks ) * 1000.0 / frames, ps.misses, ps.hits );
+
+	TEST_CHECK( ps.misses == ps.items && ps.evictions == 0 );
+
+	d3d9_graph_free( graph );
+	d3d9_respool_free( pool );
+}
+
+int main( int argc, char ** argv )
+{
+	d3d9_device_t  * device = d3d9_null_device_create( nullp );
+	d3d9_surface_t * back   = nullp;
+	u32              frames = test_arg( argc, argv, 1, 1000 );
+
+	TEST_CHECK( device->vtbl->getBackBuffer( device, 0, 0, 0, & back ) == D3D9_OK && back );
+
+	test_pool( device );
+	test_aliasing( device, back );
+	test_invalid( device );
+	test_benchmark( device, back, frames );
+
+	back->vtbl->release( back );
+
+	TEST_CHECK( device->vtbl->release( device ) == 0 );
+
+	return test_done( "grph" );
+}
@@ -0,0 +1,706 @@
+/*
+ * mesh.c : Tests & Benchmark Of D3D9MESH.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * A vertex cache simulator of its own, a queue for FIFO caches & a list for
+ * LRU ones, checks the counts of d3d9_mesh_simulate() on small meshes worked
+ * out by hand, then on every mesh below before & after its optimization.
+ *
+ * Flat grids, bumpy grids (heights between 0 & 6) and tori, their triangles
+ * & vertices shuffled, are optimized for FIFO & LRU caches of several sizes,
+ * in 16 & 32 bit indices, with & without the overdraw pass, in chunks of
+ * the default size, of 4096 and of 1001 triangles (an odd size, which once
+ * left the scratch memory of the tasks misaligned). The optimized mesh must
+ * hold the same triangles, winding kept, over vertices which are those of
+ * the remap table, with none left unused; the report must match the
+ * simulator, and the ACMR must beat the bound of its kind of mesh. The
+ * chunks split over threads must give the same mesh as on one thread.
+ *
+ * Also times the optimization of a grid of 1M triangles on 1 & on the given
+ * number of threads.
+ *
+ *    mesh [benchmark grid size] [threads]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9MESH.H"
+#include "TEST.H"
+
+#include <math.h>
+
+//! Kinds of test meshes
+enum test_shape_e
+{
+	e_test_flat  = 0, //!< Flat grid
+	e_test_bumpy = 1, //!< Grid whose heights vary between 0 & 6
+	e_test_torus = 2, //!< Torus, closed
+};
+
+//! A vertex of a test mesh
+typedef struct TEST_VERTEX_T
+{
+	f32 position[3] ;//!< Position
+	u32 id          ;//!< Index of the vertex before any shuffle
+}
+test_vertex_t; //!< A vertex of a test mesh
+
+//! A test mesh, with 32 bit indices
+typedef struct TEST_MESH_T
+{
+	test_vertex_t * vertices    ;//!< The vertices
+	u32           * indices     ;//!< Three indices per triangle
+	u32             vertexCount ;//!< Number of vertices
+	u32             indexCount  ;//!< Number of indices
+}
+test_mesh_t; //!< A test mesh, with 32 bit indices
+
+//! An optimization to check
+typedef struct TEST_CASE_T
+{
+	u32           shape    ;//!< e_test_*
+	u32           width    ;//!< Quads around
+	u32           height   ;//!< Quads across
+	d3d9_format_t format   ;//!< Index format
+	u32           policy   ;//!< e_d3d9_mesh_fifo or e_d3d9_mesh_lru
+	u32           size     ;//!< Cache size
+	f32           overdraw ;//!< Cluster threshold, 0 for none
+	u32           chunk    ;//!< Triangles per chunk, 0 for the default
+	f32           bound    ;//!< Largest ACMR after
+}
+test_case_t; //!< An optimization to check
+
+//! Names of the shapes
+static const char * g_test_shapes[] = { "flat grid", "bumpy grid", "torus" };
+
+
+/****************************************************************************
+ * Cache simulator
+ ****************************************************************************/
+
+/**
+ * Counts the vertices a cache transforms over an index list: a FIFO cache
+ * is a queue which a miss pushes into, an LRU cache a list which every
+ * vertex moves to the front of.
+ */
+static void test_simulate(
+	const u32         * indices,
+	u32                 count,
+	u32                 vertexCount,
+	u32                 policy,
+	u32                 size,
+	d3d9_mesh_stats_t * stats )
+{
+	u32   cache[ D3D9_MESH_MAX_CACHE ];
+	u08 * seen   = (u08 *) calloc( vertexCount + 1, 1 );
+	u32   filled = 0;
+	u32   oldest = 0;
+	u32   i;
+	u32   j;
+
+	memset( stats, 0, sizeof( d3d9_mesh_stats_t ) );
+
+	for ( i = 0; i < count; i++ )
+	{
+		u32 v = indices[i];
+
+		if ( !seen[v] )
+		{
+			seen[v] = 1;
+
+			stats->vertices++;
+		}
+
+		for ( j = 0; j < filled && cache[ ( oldest + j ) % size ] != v; j++ )
+		{
+		}
+
+		if ( policy == e_d3d9_mesh_fifo )
+		{
+			if ( j < filled )
+			{
+				continue;
+			}
+
+			stats->transforms++;
+
+			if ( filled < size )
+			{
+				cache[ filled++ ] = v;
+			}
+			else
+			{
+				cache[ oldest ] = v;
+				oldest = ( oldest + 1 ) % size;
+			}
+
+			continue;
+		}
+
+		// LRU, the front at 0: a hit moves up, a miss drops the last one
+		if ( j == filled )
+		{
+			stats->transforms++;
+
+			j = filled < size ? filled++ : filled - 1;
+		}
+
+		for ( ; j > 0; j-- )
+		{
+			cache[j] = cache[ j - 1 ];
+		}
+
+		cache[0] = v;
+	}
+
+	stats->triangles = count / 3;
+	stats->acmr      = stats->triangles ? (f32) stats->transforms / stats->triangles : 0.0f;
+	stats->atvr      = stats->vertices  ? (f32) stats->transforms / stats->vertices  : 0.0f;
+
+	free( seen );
+}
+
+//! Checks d3d9_mesh_simulate() against the simulator
+//! @return the number of differences
+static u32 test_check_simulate( const test_mesh_t * m, u32 policy, u32 size )
+{
+	d3d9_mesh_t       mesh;
+	d3d9_mesh_cache_t cache;
+	d3d9_mesh_stats_t a;
+	d3d9_mesh_stats_t b;
+
+	memset( & mesh, 0, sizeof( mesh ) );
+
+	mesh.indices     = m->indices;
+	mesh.format      = e_d3d9_fmt_index32;
+	mesh.indexCount  = m->indexCount;
+	mesh.vertexCount = m->vertexCount;
+
+	cache.policy = policy;
+	cache.size   = size;
+
+	test_simulate( m->indices, m->indexCount, m->vertexCount, policy, size, & a );
+
+	if ( d3d9_mesh_simulate( & mesh, & cache, & b ) != D3D9_OK )
+	{
+		return 1;
+	}
+
+	return ( a.triangles != b.triangles ) + ( a.vertices != b.vertices ) + ( a.transforms != b.transforms )
+	     + ( fabs( a.acmr - b.acmr ) > 1e-6 ) + ( fabs( a.atvr - b.atvr ) > 1e-6 );
+}
+
+
+/****************************************************************************
+ * Meshes
+ ****************************************************************************/
+
+//! Builds a shape of @p w x @p h quads, its triangles & vertices shuffled
+static void test_build( test_mesh_t * m, u32 shape, u32 w, u32 h, u32 seed )
+{
+	u32             torus = shape == e_test_torus;
+	u32             cols  = torus ? w : w + 1;
+	u32             rows  = torus ? h : h + 1;
+	u32           * perm;
+	test_vertex_t * v;
+	u32             x;
+	u32             y;
+	u32             i;
+	u32             k;
+
+	m->vertexCount = cols * rows;
+	m->indexCount  = w * h * 6;
+	m->vertices    = (test_vertex_t *) malloc( sizeof( test_vertex_t ) * m->vertexCount );
+	m->indices     = (u32 *) malloc( sizeof( u32 ) * m->indexCount );
+
+	v    = (test_vertex_t *) malloc( sizeof( test_vertex_t ) * m->vertexCount );
+	perm = (u32 *) malloc( sizeof( u32 ) * m->vertexCount );
+
+	for ( y = 0; y < rows; y++ )
+	{
+		for ( x = 0; x < cols; x++ )
+		{
+			test_vertex_t * q = & v[ y * cols + x ];
+
+			if ( torus )
+			{
+				f32 a = (f32) x * 6.2831853f / (f32) w;
+				f32 b = (f32) y * 6.2831853f / (f32) h;
+				f32 r = 1.0f + 0.4f * cosf( b );
+
+				q->position[0] = r * cosf( a );
+				q->position[1] = r * sinf( a );
+				q->position[2] = 0.4f * sinf( b );
+			}
+			else
+			{
+				q->position[0] = (f32) x;
+				q->position[1] = (f32) y;
+				q->position[2] = shape == e_test_bumpy
+					? 3.0f + 3.0f * sinf( (f32) x * 0.37f ) * cosf( (f32) y * 0.23f ) : 0.0f;
+			}
+
+			q->id = y * cols + x;
+		}
+	}
+
+	for ( i = 0, y = 0; y < h; y++ )
+	{
+		for ( x = 0; x < w; x++ )
+		{
+			u32 a = y * cols + x;
+			u32 b = y * cols + ( x + 1 ) % cols;
+			u32 c = ( y + 1 ) % rows * cols + x;
+			u32 d = ( y + 1 ) % rows * cols + ( x + 1 ) % cols;
+
+			m->indices[ i++ ] = a;
+			m->indices[ i++ ] = b;
+			m->indices[ i++ ] = d;
+			m->indices[ i++ ] = a;
+			m->indices[ i++ ] = d;
+			m->indices[ i++ ] = c;
+		}
+	}
+
+	// the triangles in random order, then the vertices
+	for ( i = m->indexCount / 3 - 1; i > 0; i-- )
+	{
+		u32 j = test_rand( & seed ) % ( i + 1 );
+
+		for ( k = 0; k < 3; k++ )
+		{
+			u32 t = m->indices[ i * 3 + k ];
+
+			m->indices[ i * 3 + k ] = m->indices[ j * 3 + k ];
+			m->indices[ j * 3 + k ] = t;
+		}
+	}
+
+	for ( i = 0; i < m->vertexCount; i++ )
+	{
+		perm[i] = i;
+	}
+
+	for ( i = m->vertexCount - 1; i > 0; i-- )
+	{
+		u32 j = test_rand( & seed ) % ( i + 1 );
+		u32 t = perm[i];
+
+		perm[i] = perm[j];
+		perm[j] = t;
+	}
+
+	for ( i = 0; i < m->vertexCount; i++ )
+	{
+		m->vertices[ perm[i] ] = v[i];
+	}
+
+	for ( i = 0; i < m->indexCount; i++ )
+	{
+		m->indices[i] = perm[ m->indices[i] ];
+	}
+
+	free( perm );
+	free( v );
+}
+
+//! Copies a mesh
+static void test_copy( test_mesh_t * dst, const test_mesh_t * src )
+{
+	*dst = *src;
+
+	dst->vertices = (test_vertex_t *) malloc( sizeof( test_vertex_t ) * src->vertexCount );
+	dst->indices  = (u32 *) malloc( sizeof( u32 ) * src->indexCount );
+
+	memcpy( dst->vertices, src->vertices, sizeof( test_vertex_t ) * src->vertexCount );
+	memcpy( dst->indices, src->indices, sizeof( u32 ) * src->indexCount );
+}
+
+//! Frees a mesh
+static void test_free( test_mesh_t * m )
+{
+	free( m->vertices );
+	free( m->indices );
+}
+
+//! Rotates a triangle so that its smallest index comes first, keeping its
+//! winding
+static void test_rotate( u32 * t )
+{
+	while ( t[0] > t[1] || t[0] > t[2] )
+	{
+		u32 x = t[0];
+
+		t[0] = t[1];
+		t[1] = t[2];
+		t[2] = x;
+	}
+}
+
+//! Orders triangles by their indices
+static int test_compare( const void * a, const void * b )
+{
+	const u32 * p = (const u32 *) a;
+	const u32 * q = (const u32 *) b;
+	u32         i;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		if ( p[i] != q[i] )
+		{
+			return p[i] < q[i] ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Checks that @p after holds the triangles of @p before, winding kept,
+ * over the vertices of the remap table, none of them left unused.
+ *
+ * @return the number of differences
+ */
+static u32 test_check_mesh( const test_mesh_t * before, const test_mesh_t * after, const u32 * remap )
+{
+	u32 * a    = (u32 *) malloc( sizeof( u32 ) * before->indexCount );
+	u32 * b    = (u32 *) malloc( sizeof( u32 ) * before->indexCount );
+	u08 * used = (u08 *) calloc( after->vertexCount + 1, 1 );
+	u32   bad  = after->indexCount != before->indexCount;
+	u32   i;
+
+	for ( i = 0; !bad && i < before->indexCount; i++ )
+	{
+		a[i] = remap[ before->indices[i] ];
+		b[i] = after->indices[i];
+
+		if ( a[i] >= after->vertexCount || b[i] >= after->vertexCount )
+		{
+			bad++;
+
+			break;
+		}
+
+		used[ b[i] ] = 1;
+	}
+
+	for ( i = 0; !bad && i < before->indexCount; i += 3 )
+	{
+		test_rotate( a + i );
+		test_rotate( b + i );
+	}
+
+	if ( !bad )
+	{
+		qsort( a, before->indexCount / 3, sizeof( u32 ) * 3, test_compare );
+		qsort( b, before->indexCount / 3, sizeof( u32 ) * 3, test_compare );
+
+		bad += memcmp( a, b, sizeof( u32 ) * before->indexCount ) != 0;
+	}
+
+	// a vertex keeps its data, and every vertex left is used
+	for ( i = 0; !bad && i < before->vertexCount; i++ )
+	{
+		if ( remap[i] != ~0u && after->vertices[ remap[i] ].id != before->vertices[i].id )
+		{
+			bad++;
+		}
+	}
+
+	for ( i = 0; !bad && i < after->vertexCount; i++ )
+	{
+		bad += !used[i];
+	}
+
+	free( used );
+	free( b );
+	free( a );
+
+	return bad;
+}
+
+/**
+ * Optimizes a copy of @p m into @p out for @p c, on @p par if not nullp.
+ *
+ * @return the time taken, in ticks
+ */
+static u64 test_optimize(
+	const test_mesh_t     * m,
+	const test_case_t     * c,
+	const d3d9_parallel_t * par,
+	test_mesh_t           * out,
+	u32                   * remap,
+	d3d9_mesh_report_t    * report )
+{
+	d3d9_mesh_desc_t   desc;
+	d3d9_mesh_t        mesh;
+	u16              * small = nullp;
+	u64                t;
+	u32                i;
+
+	test_copy( out, m );
+
+	if ( c->format == e_d3d9_fmt_index16 )
+	{
+		small = (u16 *) malloc( sizeof( u16 ) * m->indexCount );
+
+		for ( i = 0; i < m->indexCount; i++ )
+		{
+			small[i] = (u16) m->indices[i];
+		}
+	}
+
+	memset( & desc, 0, sizeof( desc ) );
+
+	desc.cache.policy = c->policy;
+	desc.cache.size   = c->size;
+	desc.overdraw     = c->overdraw;
+	desc.fetch        = hf_true;
+	desc.chunk        = c->chunk;
+
+	mesh.indices     = small ? (void *) small : (void *) out->indices;
+	mesh.format      = c->format;
+	mesh.indexCount  = m->indexCount;
+	mesh.vertices    = out->vertices;
+	mesh.vertexCount = m->vertexCount;
+	mesh.stride      = sizeof( test_vertex_t );
+	mesh.position    = 0;
+
+	t = d3d9_ticks();
+
+	TEST_CHECK( d3d9_mesh_optimize( & mesh, & desc, remap, report, par ) == D3D9_OK );
+
+	t = d3d9_ticks() - t;
+
+	out->vertexCount = mesh.vertexCount;
+
+	for ( i = 0; small && i < m->indexCount; i++ )
+	{
+		out->indices[i] = small[i];
+	}
+
+	free( small );
+
+	return t;
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! The simulator on meshes worked out by hand, and bad meshes
+static void test_small( void )
+{
+	// a strip of 4 triangles, then the first one again
+	static const u32 strip[] = { 0,1,2, 1,3,2, 2,3,4, 3,5,4, 0,1,2 };
+
+	// a fan of 6 triangles around 0
+	static const u32 fan[] = { 0,1,2, 0,2,3, 0,3,4, 0,4,5, 0,5,6, 0,6,1 };
+
+	d3d9_devinfo_vcache_t vcache = { D3D9_MESH_VCACHE_PATTERN, 1, 24, 7 };
+	d3d9_mesh_cache_t     cache;
+	d3d9_mesh_stats_t     s;
+	d3d9_mesh_t           mesh;
+	u16                   tri[3] = { 0, 1, 2 };
+	test_mesh_t           m;
+
+	// a FIFO of 3 keeps the last 3 misses: 0 1 2 3 4 5, then 0 1 2 again
+	test_simulate( strip, 15, 6, e_d3d9_mesh_fifo, 3, & s );
+	TEST_CHECK( s.triangles == 5 && s.vertices == 6 && s.transforms == 9 );
+
+	// an LRU of 3 keeps 3 4 5 before the last triangle: 0 1 2 again
+	test_simulate( strip, 15, 6, e_d3d9_mesh_lru, 3, & s );
+	TEST_CHECK( s.transforms == 9 );
+
+	// a cache of 6 holds them all
+	test_simulate( strip, 15, 6, e_d3d9_mesh_fifo, 6, & s );
+	TEST_CHECK( s.transforms == 6 );
+
+	// a hit keeps the center of a fan in an LRU but not in a FIFO: the
+	// FIFO misses 0 1 2 3, 0 4 5 6, 0 1 & the LRU 0 1 2 3 4 5 6, 1
+	test_simulate( fan, 18, 7, e_d3d9_mesh_fifo, 3, & s );
+	TEST_CHECK( s.transforms == 10 );
+	test_simulate( fan, 18, 7, e_d3d9_mesh_lru, 3, & s );
+	TEST_CHECK( s.transforms == 8 );
+
+	m.indices     = (u32 *) strip;
+	m.indexCount  = 15;
+	m.vertexCount = 6;
+
+	TEST_CHECK( test_check_simulate( & m, e_d3d9_mesh_fifo, 3 ) == 0 );
+	TEST_CHECK( test_check_simulate( & m, e_d3d9_mesh_lru, 3 ) == 0 );
+
+	m.indices     = (u32 *) fan;
+	m.indexCount  = 18;
+	m.vertexCount = 7;
+
+	TEST_CHECK( test_check_simulate( & m, e_d3d9_mesh_fifo, 3 ) == 0 );
+	TEST_CHECK( test_check_simulate( & m, e_d3d9_mesh_lru, 3 ) == 0 );
+	TEST_CHECK( test_check_simulate( & m, e_d3d9_mesh_lru, 4 ) == 0 );
+
+	// the hints of the driver, and the default
+	TEST_CHECK( d3d9_mesh_cache_from_vcache( & vcache, & cache ) );
+	TEST_CHECK( cache.policy == e_d3d9_mesh_fifo && cache.size == 24 );
+
+	vcache.optMethod = 0;
+
+	TEST_CHECK( !d3d9_mesh_cache_from_vcache( & vcache, & cache ) );
+	TEST_CHECK( cache.policy == e_d3d9_mesh_fifo && cache.size == D3D9_MESH_CACHE );
+	TEST_CHECK( !d3d9_mesh_cache_from_vcache( nullp, & cache ) && cache.size == D3D9_MESH_CACHE );
+
+	// an index past the vertices, a count not of triangles
+	memset( & mesh, 0, sizeof( mesh ) );
+
+	mesh.indices     = tri;
+	mesh.format      = e_d3d9_fmt_index16;
+	mesh.indexCount  = 3;
+	mesh.vertexCount = 3;
+
+	TEST_CHECK( d3d9_mesh_simulate( & mesh, & cache, & s ) == D3D9_OK && s.transforms == 3 );
+
+	tri[2] = 3;
+
+	TEST_CHECK( d3d9_mesh_simulate( & mesh, & cache, & s ) == D3D9_ERR_INVALIDCALL );
+
+	tri[2]          = 2;
+	mesh.indexCount = 2;
+
+	TEST_CHECK( d3d9_mesh_simulate( & mesh, & cache, & s ) == D3D9_ERR_INVALIDCALL );
+}
+
+//! Optimizes a mesh for a case, serially & on @p threads threads
+static void test_case( const test_case_t * c, u32 threads )
+{
+	d3d9_parallel_t    par = test_parallel( threads );
+	d3d9_mesh_report_t report;
+	d3d9_mesh_report_t again;
+	d3d9_mesh_stats_t  before;
+	d3d9_mesh_stats_t  after;
+	test_mesh_t        m;
+	test_mesh_t        serial;
+	test_mesh_t        parallel;
+	u32              * remap;
+	u32                bad = 0;
+	u64                t;
+
+	test_build( & m, c->shape, c->width, c->height, c->width * 31 + c->shape );
+
+	remap = (u32 *) malloc( sizeof( u32 ) * m.vertexCount );
+
+	t = test_optimize( & m, c, nullp, & serial, remap, & report );
+
+	bad += test_check_mesh( & m, & serial, remap );
+
+	// the report is what the simulator counts
+	test_simulate( m.indices, m.indexCount, m.vertexCount, c->policy, c->size, & before );
+	test_simulate( serial.indices, serial.indexCount, serial.vertexCount, c->policy, c->size, & after );
+
+	bad += report.before.transforms != before.transforms || report.before.vertices != before.vertices;
+	bad += report.after.transforms  != after.transforms  || report.after.vertices  != after.vertices;
+	bad += test_check_simulate( & m, c->policy, c->size ) + test_check_simulate( & serial, c->policy, c->size );
+
+	// fetch leaves only the vertices used, a grid has no vertex left over
+	bad += serial.vertexCount != after.vertices || after.vertices != m.vertexCount;
+
+	printf( "mesh: %-10s %7u tris, %s %s %2u%s%s, chunks of %5u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %.1f ms\n",
+		g_test_shapes[ c->shape ], m.indexCount / 3, c->format == e_d3d9_fmt_index16 ? "i16" : "i32",
+		c->policy == e_d3d9_mesh_lru ? "LRU " : "FIFO", c->size, c->overdraw > 0.0f ? ", overdraw" : "",
+		c->chunk && c->chunk % 2 ? ", odd" : "", c->chunk ? c->chunk : D3D9_MESH_CHUNK,
+		before.acmr, after.acmr, before.atvr, after.atvr, test_ms( t ) );
+
+	TEST_CHECK( bad == 0 );
+	TEST_CHECK( after.acmr <= c->bound && after.acmr < before.acmr );
+	TEST_CHECK( after.atvr >= 1.0f && after.atvr < before.atvr );
+
+	// the chunks split over threads give the same mesh
+	test_optimize( & m, c, & par, & parallel, remap, & again );
+
+	TEST_CHECK( parallel.vertexCount == serial.vertexCount );
+	TEST_CHECK( !memcmp( parallel.indices, serial.indices, sizeof( u32 ) * m.indexCount ) );
+	TEST_CHECK( !memcmp( parallel.vertices, serial.vertices, sizeof( test_vertex_t ) * serial.vertexCount ) );
+	TEST_CHECK( again.after.transforms == report.after.transforms );
+
+	test_free( & parallel );
+	test_free( & serial );
+	test_free( & m );
+	free( remap );
+}
+
+//! Times the optimization of a grid on 1 thread & on @p threads threads
+static void test_benchmark( u32 size, u32 threads )
+{
+	d3d9_parallel_t    one = test_parallel( 1 );
+	d3d9_parallel_t    par = test_parallel( threads );
+	d3d9_mesh_report_t report;
+	test_case_t        c   = { e_test_flat, 0, 0, e_d3d9_fmt_index32, e_d3d9_mesh_fifo, 16, 0.0f, 0, 0.0f };
+	test_mesh_t        m;
+	test_mesh_t        out;
+	u32              * remap;
+	u64                t[2];
+	u32                i;
+
+	c.width  = size;
+	c.height = size;
+
+	test_build( & m, c.shape, size, size, 7 );
+
+	remap = (u32 *) malloc( sizeof( u32 ) * m.vertexCount );
+
+	for ( i = 0; i < 2; i++ )
+	{
+		c.policy = i ? e_d3d9_mesh_lru : e_d3d9_mesh_fifo;
+		c.size   = i ? 32 : 16;
+
+		t[0] = test_optimize( & m, & c, & one, & out, remap, & report );
+		test_free( & out );
+
+		t[1] = test_optimize( & m, & c, & par, & out, remap, & report );
+		TEST_CHECK( test_check_mesh( & m, & out, remap ) == 0 );
+		test_free( & out );
+
+		printf( "mesh: %u tris, %s %u, ACMR %.3f -> %.3f, %.1f ms on 1 thread, %.1f ms on %u (%.1f Mtris/s)\n",
+			m.indexCount / 3, i ? "LRU" : "FIFO", c.size, report.before.acmr, report.after.acmr,
+			test_ms( t[0] ), test_ms( t[1] ), threads, m.indexCount / 3 / test_ms( t[1] ) / 1000.0 );
+	}
+
+	test_free( & m );
+	free( remap );
+}
+
+int main( int argc, char ** argv )
+{
+	static const test_case_t cases[] =
+	{
+		{ e_test_flat,  180, 180, e_d3d9_fmt_index16, e_d3d9_mesh_fifo, 16, 0.0f,  0,    0.66f },
+		{ e_test_flat,  180, 180, e_d3d9_fmt_index16, e_d3d9_mesh_lru,  32, 0.0f,  0,    0.73f },
+		{ e_test_flat,  180, 180, e_d3d9_fmt_index32, e_d3d9_mesh_fifo, 24, 0.0f,  1001, 0.69f },
+		{ e_test_bumpy, 200, 200, e_d3d9_fmt_index32, e_d3d9_mesh_fifo, 16, 0.0f,  0,    0.66f },
+		{ e_test_bumpy, 200, 200, e_d3d9_fmt_index32, e_d3d9_mesh_fifo, 16, 0.0f,  4096, 0.69f },
+		{ e_test_bumpy, 200, 200, e_d3d9_fmt_index16, e_d3d9_mesh_lru,  16, 0.0f,  1001, 0.77f },
+		{ e_test_torus, 300, 100, e_d3d9_fmt_index16, e_d3d9_mesh_fifo, 16, 0.0f,  4096, 0.70f },
+		{ e_test_torus, 300, 100, e_d3d9_fmt_index16, e_d3d9_mesh_fifo, 16, 1.05f, 4096, 0.75f },
+		{ e_test_torus, 300, 100, e_d3d9_fmt_index32, e_d3d9_mesh_lru,  32, 1.05f, 0,    0.76f },
+		{ e_test_torus, 300, 100, e_d3d9_fmt_index16, e_d3d9_mesh_fifo, 16, 1.05f, 1001, 0.81f },
+	};
+
+	u32 size    = test_arg( argc, argv, 1, 708 );
+	u32 threads = test_arg( argc, argv, 2, 8 );
+	u32 i;
+
+	test_small();
+
+	for ( i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ )
+	{
+		test_case( & cases[i], threads );
+	}
+
+	test_benchmark( size, threads );
+
+	return test_done( "mesh" );
+}
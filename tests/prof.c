@@ -0,0 +1,702 @@
+/*
+ * prof.c : Tests & Benchmark Of D3D9PROF.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * Frames of 50 draws & 100 state changes go through the profiling device in
+ * front of the null device, whose queries answer a number of Presents after
+ * their Issue: the latency of the GPU. At latencies 0, 3 & 5 with 4 query
+ * sets, the profiler must never call GetData with D3D9_GETDATA_FLUSH, must
+ * read every frame the latency of the GPU behind when it has a set free,
+ * and must skip frames instead of waiting when every set is in flight (as
+ * at latency 5, or with a ring of 1 set). The counters of every kept frame
+ * must be those the frame made, a worker thread counting into its own
+ * counters included, and the histograms & the JSON must agree with them.
+ * The JSON is parsed, names with quotes & control characters included.
+ *
+ * Also times a scope, a count, a draw through the profiling device & a
+ * Present with a GPU scope.
+ *
+ *    prof [frames]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9NULL.H"
+#include "D3D9PROF.H"
+#include "TEST.H"
+
+#include <sched.h>
+
+//! Draws of a frame
+#define TEST_DRAWS 50
+
+//! Bytes of the lock the frame thread counts each frame
+#define TEST_LOCK 4096
+
+//! Bytes of each lock the worker counts
+#define TEST_WORKER_LOCK 64
+
+//! Name of a GPU scope which needs escaping in the JSON
+#define TEST_ESCAPED "Post \"fx\" \\ \t"
+
+//! A JSON dump in memory
+typedef struct TEST_JSON_T
+{
+	char * text     ;//!< The dump, 0 terminated
+	u32    bytes    ;//!< Size of the dump
+	u32    capacity ;//!< Size of text
+}
+test_json_t; //!< A JSON dump in memory
+
+//! Parses a JSON text, counting the events by phase
+typedef struct TEST_PARSER_T
+{
+	const char * at       ;//!< Next character
+	u32          depth    ;//!< Nesting of objects & arrays
+	u32          complete ;//!< "ph":"X" events
+	u32          counters ;//!< "ph":"C" events
+	u32          meta     ;//!< "ph":"M" events
+	u32          gpu      ;//!< "cat":"gpu" events
+	u32          escaped  ;//!< Strings equal to TEST_ESCAPED once decoded
+}
+test_parser_t; //!< Parses a JSON text, counting the events by phase
+
+//! A worker thread counting locks & timing scopes
+typedef struct TEST_WORKER_T
+{
+	d3d9_prof_t * prof  ;//!< The profiler
+	u32           stop  ;//!< Non-zero to stop
+	u32           asked ;//!< Locks the frame thread asked for
+	u32           locks ;//!< Locks counted
+}
+test_worker_t; //!< A worker thread counting locks & timing scopes
+
+
+/****************************************************************************
+ * JSON
+ ****************************************************************************/
+
+//! Appends text of the dump
+static void test_json_write( void * user, const char * text, u32 bytes )
+{
+	test_json_t * j = (test_json_t *) user;
+
+	if ( j->bytes + bytes + 1 > j->capacity )
+	{
+		j->capacity = ( j->bytes + bytes + 1 ) * 2;
+		j->text     = (char *) realloc( j->text, j->capacity );
+	}
+
+	memcpy( j->text + j->bytes, text, bytes );
+
+	j->bytes += bytes;
+	j->text[ j->bytes ] = 0;
+}
+
+//! Skips white space
+static void test_json_space( test_parser_t * p )
+{
+	while ( *p->at == ' ' || *p->at == '\n' || *p->at == '\r' || *p->at == '\t' )
+	{
+		p->at++;
+	}
+}
+
+static hbool test_json_value( test_parser_t * p );
+
+//! Parses a string, decoding it into @p out of @p size bytes if given
+static hbool test_json_string( test_parser_t * p, char * out, u32 size )
+{
+	u32 n = 0;
+
+	if ( *p->at++ != '"' )
+	{
+		return hf_false;
+	}
+
+	while ( *p->at != '"' )
+	{
+		char c = *p->at++;
+
+		if ( (u08) c < 0x20 )
+		{
+			return hf_false;
+		}
+
+		if ( c == '\\' )
+		{
+			const char * esc = "\"\\/bfnrt";
+			const char * dec = "\"\\/\b\f\n\r\t";
+			const char * k   = strchr( esc, *p->at );
+			u32          i;
+
+			if ( *p->at == 'u' )
+			{
+				for ( i = 1, c = 0; i <= 4; i++ )
+				{
+					char h = p->at[i];
+
+					if ( !( ( h >= '0' && h <= '9' ) || ( h >= 'a' && h <= 'f' ) || ( h >= 'A' && h <= 'F' ) ) )
+					{
+						return hf_false;
+					}
+
+					c = (char)( c * 16 + ( h <= '9' ? h - '0' : ( h | 32 ) - 'a' + 10 ) );
+				}
+
+				p->at += 5;
+			}
+			else if ( *p->at && k )
+			{
+				c = dec[ k - esc ];
+
+				p->at++;
+			}
+			else
+			{
+				return hf_false;
+			}
+		}
+
+		if ( out && n + 1 < size )
+		{
+			out[ n++ ] = c;
+		}
+	}
+
+	p->at++;
+
+	if ( out )
+	{
+		out[n] = 0;
+	}
+
+	return hf_true;
+}
+
+//! Skips digits
+//! @return the number of digits skipped
+static u32 test_json_digits( test_parser_t * p )
+{
+	const char * start = p->at;
+
+	while ( *p->at >= '0' && *p->at <= '9' )
+	{
+		p->at++;
+	}
+
+	return (u32)( p->at - start );
+}
+
+//! Parses a number
+static hbool test_json_number( test_parser_t * p )
+{
+	if ( *p->at == '-' )
+	{
+		p->at++;
+	}
+
+	// no leading zero
+	if ( p->at[0] == '0' && p->at[1] >= '0' && p->at[1] <= '9' )
+	{
+		return hf_false;
+	}
+
+	if ( !test_json_digits( p ) )
+	{
+		return hf_false;
+	}
+
+	if ( *p->at == '.' )
+	{
+		p->at++;
+
+		if ( !test_json_digits( p ) )
+		{
+			return hf_false;
+		}
+	}
+
+	if ( *p->at == 'e' || *p->at == 'E' )
+	{
+		p->at++;
+
+		if ( *p->at == '+' || *p->at == '-' )
+		{
+			p->at++;
+		}
+
+		if ( !test_json_digits( p ) )
+		{
+			return hf_false;
+		}
+	}
+
+	return hf_true;
+}
+
+//! Parses an object, counting the events by their phase & category
+static hbool test_json_object( test_parser_t * p )
+{
+	char key[64];
+	char value[64];
+
+	p->at++;
+	test_json_space( p );
+
+	if ( *p->at == '}' )
+	{
+		p->at++;
+
+		return hf_true;
+	}
+
+	for ( ;; )
+	{
+		test_json_space( p );
+
+		if ( !test_json_string( p, key, sizeof( key ) ) )
+		{
+			return hf_false;
+		}
+
+		test_json_space( p );
+
+		if ( *p->at++ != ':' )
+		{
+			return hf_false;
+		}
+
+		test_json_space( p );
+
+		if ( *p->at == '"' )
+		{
+			if ( !test_json_string( p, value, sizeof( value ) ) )
+			{
+				return hf_false;
+			}
+
+			if ( !strcmp( key, "ph" ) )
+			{
+				p->complete += !strcmp( value, "X" );
+				p->counters += !strcmp( value, "C" );
+				p->meta     += !strcmp( value, "M" );
+			}
+
+			p->gpu     += !strcmp( key, "cat" ) && !strcmp( value, "gpu" );
+			p->escaped += !strcmp( key, "name" ) && !strcmp( value, TEST_ESCAPED );
+		}
+		else if ( !test_json_value( p ) )
+		{
+			return hf_false;
+		}
+
+		test_json_space( p );
+
+		if ( *p->at == '}' )
+		{
+			p->at++;
+
+			return hf_true;
+		}
+
+		if ( *p->at++ != ',' )
+		{
+			return hf_false;
+		}
+	}
+}
+
+//! Parses an array
+static hbool test_json_array( test_parser_t * p )
+{
+	p->at++;
+	test_json_space( p );
+
+	if ( *p->at == ']' )
+	{
+		p->at++;
+
+		return hf_true;
+	}
+
+	for ( ;; )
+	{
+		if ( !test_json_value( p ) )
+		{
+			return hf_false;
+		}
+
+		test_json_space( p );
+
+		if ( *p->at == ']' )
+		{
+			p->at++;
+
+			return hf_true;
+		}
+
+		if ( *p->at++ != ',' )
+		{
+			return hf_false;
+		}
+	}
+}
+
+//! Parses any value
+static hbool test_json_value( test_parser_t * p )
+{
+	hbool ok;
+
+	test_json_space( p );
+
+	if ( p->depth > 64 )
+	{
+		return hf_false;
+	}
+
+	switch ( *p->at )
+	{
+	case '{' : p->depth++; ok = test_json_object( p ); p->depth--; return ok;
+	case '[' : p->depth++; ok = test_json_array( p ); p->depth--; return ok;
+	case '"' : return test_json_string( p, nullp, 0 );
+	case 't' : p->at += 4; return !strncmp( p->at - 4, "true", 4 );
+	case 'f' : p->at += 5; return !strncmp( p->at - 5, "false", 5 );
+	case 'n' : p->at += 4; return !strncmp( p->at - 4, "null", 4 );
+	default  : return test_json_number( p );
+	}
+}
+
+//! Parses a whole JSON text
+static hbool test_json_parse( test_parser_t * p, const char * text )
+{
+	memset( p, 0, sizeof( test_parser_t ) );
+
+	p->at = text;
+
+	if ( *p->at != '{' || !test_json_value( p ) )
+	{
+		return hf_false;
+	}
+
+	test_json_space( p );
+
+	return *p->at == 0;
+}
+
+
+/****************************************************************************
+ * Frames
+ ****************************************************************************/
+
+//! Counts a lock in a scope each time the frame thread asks, until stopped
+static void * test_counting( void * arg )
+{
+	test_worker_t      * w = (test_worker_t *) arg;
+	d3d9_prof_thread_t * t = d3d9_prof_attach( w->prof, "Worker" );
+
+	TEST_CHECK( t != nullp );
+
+	while ( !D3D9_ATOMIC_LOAD_U32( & w->stop ) )
+	{
+		if ( D3D9_ATOMIC_LOAD_U32( & w->asked ) == w->locks )
+		{
+			sched_yield();
+
+			continue;
+		}
+
+		d3d9_prof_begin( t, "Cull" );
+		d3d9_prof_count_lock( t, TEST_WORKER_LOCK );
+		d3d9_prof_end( t );
+
+		D3D9_ATOMIC_STORE_U32( & w->locks, w->locks + 1 );
+	}
+
+	return nullp;
+}
+
+//! Plays a frame of TEST_DRAWS draws, 2 GPU scopes & a counted lock
+static void test_frame( d3d9_prof_t * prof, d3d9_device_t * dev, d3d9_prof_thread_t * main )
+{
+	u32 k;
+
+	d3d9_prof_begin( main, "Scene" );
+	d3d9_prof_gpu_begin( prof, "Scene" );
+
+	for ( k = 0; k < TEST_DRAWS; k++ )
+	{
+		dev->vtbl->setRenderState( dev, e_d3d9_rs_zenable, k & 1 );
+		dev->vtbl->setTexture( dev, 0, nullp );
+		dev->vtbl->drawPrimitive( dev, e_d3d9_pt_trianglelist, 0, 100 );
+	}
+
+	d3d9_prof_gpu_begin( prof, TEST_ESCAPED );
+	d3d9_prof_gpu_end( prof );
+	d3d9_prof_gpu_end( prof );
+	d3d9_prof_end( main );
+
+	d3d9_prof_count_lock( main, TEST_LOCK );
+
+	dev->vtbl->present( dev, nullp, nullp, 0, nullp );
+}
+
+/**
+ * Plays @p frames frames on a GPU @p latency frames behind, with @p sets
+ * query sets and a worker thread if @p worker.
+ */
+static void test_latency( u32 latency, u32 sets, u32 frames, hbool worker )
+{
+	d3d9_prof_desc_t        desc;
+	d3d9_prof_stats_t       stats;
+	d3d9_null_stats_t       ns;
+	d3d9_prof_frame_t       f;
+	d3d9_prof_histogram_t   h;
+	test_parser_t           parser;
+	test_json_t             json;
+	test_worker_t           w;
+	pthread_t               thread;
+	d3d9_device_t         * null = d3d9_null_device_create( nullp );
+	d3d9_device_t         * dev;
+	d3d9_prof_thread_t    * main;
+	d3d9_prof_t           * prof;
+	u32                     locks = worker ? 2 : 1;
+	u32                     kept;
+	u32                     bad = 0;
+	u32                     i;
+
+	memset( & desc, 0, sizeof( desc ) );
+	memset( & json, 0, sizeof( json ) );
+	memset( & w, 0, sizeof( w ) );
+
+	desc.frames      = 128;
+	desc.queryFrames = sets;
+	desc.devinfo     = hf_true;
+
+	prof = d3d9_prof_create( & desc );
+	main = d3d9_prof_frame_thread( prof );
+
+	d3d9_null_device_set_query_latency( null, latency );
+
+	dev = d3d9_prof_device( prof, null );
+
+	TEST_CHECK( dev != nullp && d3d9_prof_device( prof, null ) == nullp );
+
+	w.prof = prof;
+
+	if ( worker )
+	{
+		pthread_create( & thread, nullp, test_counting, & w );
+	}
+
+	for ( i = 0; i < frames; i++ )
+	{
+		// a lock of the worker in every frame, before the frame ends
+		if ( worker )
+		{
+			D3D9_ATOMIC_STORE_U32( & w.asked, i + 1 );
+
+			while ( D3D9_ATOMIC_LOAD_U32( & w.locks ) != i + 1 )
+			{
+				sched_yield();
+			}
+		}
+
+		test_frame( prof, dev, main );
+	}
+
+	if ( worker )
+	{
+		D3D9_ATOMIC_STORE_U32( & w.stop, 1 );
+
+		pthread_join( thread, nullp );
+	}
+
+	d3d9_null_device_get_stats( null, & ns );
+	d3d9_prof_get_stats( prof, & stats );
+
+	// the counters of every kept frame, the worker's locks included
+	for ( kept = 0; d3d9_prof_get_frame( prof, kept, & f ); kept++ )
+	{
+		const d3d9_prof_counters_t * c = & f.counters;
+
+		bad += c->draws != TEST_DRAWS || c->primitives != TEST_DRAWS * 100 || c->stateChanges != TEST_DRAWS * 2;
+		bad += c->locks != locks || c->lockedBytes != TEST_LOCK + ( locks - 1 ) * TEST_WORKER_LOCK;
+		bad += f.gpuValid && ( f.gpuLatency != latency || !f.pipelineValid || !f.resourcesValid );
+
+		// with a set free, every frame but the last ones is read
+		bad += latency < sets && kept >= latency && !f.gpuValid;
+	}
+
+	printf( "prof: latency %u, %u sets, %u frames, %u timed on the GPU, %u skipped, %u polls,"
+	        " %u not ready, %u flushes, %u worker locks, %u scopes dropped\n",
+	        latency, sets, stats.frames, stats.gpuFrames, stats.gpuSkipped, stats.polls,
+	        stats.pending, ns.flushes, w.locks, stats.scopesDropped );
+
+	TEST_CHECK( bad == 0 );
+	TEST_CHECK( ns.flushes == 0 && ns.draws == frames * TEST_DRAWS && ns.presents == frames );
+	TEST_CHECK( stats.frames == frames && kept == desc.frames - 1 );
+	TEST_CHECK( w.locks == ( worker ? frames : 0 ) && stats.scopesDropped == 0 );
+	TEST_CHECK( stats.gpuDisjoint == 0 && stats.gpuLost == 0 && stats.gpuDropped == 0 );
+
+	if ( latency < sets )
+	{
+		TEST_CHECK( stats.gpuSkipped == 0 && stats.gpuFrames == frames - latency );
+	}
+	else
+	{
+		// every set in flight: frames are skipped, never waited for
+		TEST_CHECK( stats.gpuSkipped > 0 && stats.gpuFrames + stats.gpuSkipped <= frames );
+		TEST_CHECK( stats.gpuFrames > 0 );
+	}
+
+	// the histograms agree with the frames
+	TEST_CHECK( d3d9_prof_get_histogram( prof, e_d3d9_prof_draws, nullp, & h ) );
+	TEST_CHECK( h.samples == kept && h.min == TEST_DRAWS && h.max == TEST_DRAWS && h.p50 == TEST_DRAWS );
+	TEST_CHECK( d3d9_prof_get_histogram( prof, e_d3d9_prof_cpu_scope, "Scene", & h ) && h.samples == kept );
+	TEST_CHECK( !d3d9_prof_get_histogram( prof, e_d3d9_prof_cpu_scope, "Nothing", & h ) );
+
+	if ( d3d9_prof_get_histogram( prof, e_d3d9_prof_gpu_latency, nullp, & h ) )
+	{
+		TEST_CHECK( h.min == latency && h.max == latency );
+	}
+	else
+	{
+		TEST_CHECK( stats.gpuFrames == 0 );
+	}
+
+	// the JSON parses, with the scopes, the GPU & the counters of the kept frames
+	d3d9_prof_write_json( prof, test_json_write, & json );
+
+	TEST_CHECK( json.text && test_json_parse( & parser, json.text ) );
+	TEST_CHECK( parser.counters == kept && parser.meta >= 3 );
+	TEST_CHECK( parser.complete >= parser.gpu && parser.gpu > 0 && parser.escaped > 0 );
+
+	// the queries go with the profiling device
+	TEST_CHECK( dev->vtbl->release( dev ) == 0 );
+
+	d3d9_null_device_get_stats( null, & ns );
+
+	TEST_CHECK( ns.objects == 0 );
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+
+	d3d9_prof_free( prof );
+
+	free( json.text );
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! The JSON checker refuses what isn't JSON
+static void test_parser( void )
+{
+	test_parser_t p;
+
+	TEST_CHECK( test_json_parse( & p, "{\"a\":[1,-2.5e3,\"\\u0041\\n\",true,false,null,{}],\"ph\":\"X\"}\n" ) );
+	TEST_CHECK( p.complete == 1 );
+	TEST_CHECK( !test_json_parse( & p, "{\"a\":[1,2,]}" ) );
+	TEST_CHECK( !test_json_parse( & p, "{\"a\":\"\t\"}" ) );
+	TEST_CHECK( !test_json_parse( & p, "{\"a\":01}" ) );
+	TEST_CHECK( !test_json_parse( & p, "{\"a\":1}}" ) );
+	TEST_CHECK( !test_json_parse( & p, "{\"a\":\"\\x\"}" ) );
+	TEST_CHECK( !test_json_parse( & p, "{\"a\":1" ) );
+}
+
+//! Times the calls the engine makes every frame
+static void test_benchmark( u32 count )
+{
+	d3d9_device_t      * null = d3d9_null_device_create( nullp );
+	d3d9_prof_t        * prof = d3d9_prof_create( nullp );
+	d3d9_prof_thread_t * main = d3d9_prof_frame_thread( prof );
+	d3d9_device_t      * dev;
+	u64                  t[5];
+	u32                  i;
+
+	t[0] = d3d9_ticks();
+
+	for ( i = 0; i < count; i++ )
+	{
+		d3d9_prof_begin( main, "Scope" );
+		d3d9_prof_end( main );
+
+		if ( i % 1024 == 1023 )
+		{
+			d3d9_prof_frame_end( prof );
+			d3d9_prof_frame_begin( prof );
+		}
+	}
+
+	t[1] = d3d9_ticks();
+
+	for ( i = 0; i < count; i++ )
+	{
+		d3d9_prof_count_draw( main, 3 );
+	}
+
+	t[2] = d3d9_ticks();
+
+	for ( i = 0; i < count; i++ )
+	{
+		null->vtbl->drawPrimitive( null, e_d3d9_pt_trianglelist, 0, 1 );
+	}
+
+	t[3] = d3d9_ticks();
+
+	dev = d3d9_prof_device( prof, null );
+
+	for ( i = 0; i < count; i++ )
+	{
+		dev->vtbl->drawPrimitive( dev, e_d3d9_pt_trianglelist, 0, 1 );
+	}
+
+	t[4] = d3d9_ticks();
+
+	printf( "prof: %u calls, %.1f ns a scope, %.2f ns a count, %.2f ns a draw, %.2f ns profiled\n",
+		count, test_ms( t[1] - t[0] ) * 1e6 / count, test_ms( t[2] - t[1] ) * 1e6 / count,
+		test_ms( t[3] - t[2] ) * 1e6 / count, test_ms( t[4] - t[3] ) * 1e6 / count );
+
+	t[0] = d3d9_ticks();
+
+	for ( i = 0; i < count / 100; i++ )
+	{
+		d3d9_prof_gpu_begin( prof, "Scope" );
+		d3d9_prof_gpu_end( prof );
+
+		dev->vtbl->present( dev, nullp, nullp, 0, nullp );
+	}
+
+	t[1] = d3d9_ticks();
+
+	printf( "prof: %u presents with a GPU scope, %.0f ns a present\n",
+		count / 100, test_ms( t[1] - t[0] ) * 1e6 / ( count / 100 ) );
+
+	TEST_CHECK( dev->vtbl->release( dev ) == 0 );
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+
+	d3d9_prof_free( prof );
+}
+
+int main( int argc, char ** argv )
+{
+	u32 frames = test_arg( argc, argv, 1, 500 );
+
+	test_parser();
+
+	test_latency( 0, 4, frames, hf_false );
+	test_latency( 3, 4, frames, hf_true );
+	test_latency( 5, 4, frames, hf_false );
+	test_latency( 1, 1, frames, hf_true );
+	test_latency( 0, 1, frames, hf_false );
+
+	test_benchmark( frames * 2000 );
+
+	return test_done( "prof" );
+}
@@ -0,0 +1,534 @@
+/*
+ * ring.c : Tests Of D3D9RING.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * The ring streams through a stub buffer which plays the driver: a lock
+ * with LOCK_DISCARD renames the buffer, and the allocations of a frame
+ * stay in flight until the frame is retired, a few frames later as the
+ * GPU would. Every allocation is filled with a pattern which must still
+ * be there when its frame retires, no LOCK_NOOVERWRITE lock may cover an
+ * allocation in flight, and the buffer is never locked twice.
+ *
+ * Frames of random allocations run with a latency of 0 to 7 frames, on a
+ * small buffer so that the ring wraps & discards all the time, and with
+ * frame numbers which wrap around 2^32. Also checks that the frame slots
+ * are reused once retired, and that bad allocations are refused.
+ *
+ *    ring [frames] [buffer bytes]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9FWD.H"
+#include "D3D9NULL.H"
+#include "D3D9RING.H"
+#include "TEST.H"
+
+#include <stddef.h>
+
+//! Renamed copies of the buffer kept alive, more than can be in flight
+#define TEST_INSTANCES 64
+
+//! Most allocations in flight at once
+#define TEST_RECORDS 4096
+
+//! An allocation in flight
+typedef struct TEST_RECORD_T
+{
+	u32 instance ;//!< Copy of the buffer written
+	u32 offset   ;//!< Offset in the buffer, in bytes
+	u32 bytes    ;//!< Size, in bytes
+	u32 frame    ;//!< Frame of the allocation
+	u32 tag      ;//!< Seed of the pattern written
+}
+test_record_t; //!< An allocation in flight
+
+//! A device whose buffers play the driver
+typedef struct TEST_DEVICE_T
+{
+	d3d9_fwd_device_t         fwd                       ;//!< Forwards to the null device, must be first
+	d3d9_vertex_buffer_t      vb                        ;//!< The buffer, as a vertex buffer
+	d3d9_index_buffer_t       ib                        ;//!< The buffer, as an index buffer
+	d3d9_vertex_buffer_vtbl_t vbVtbl                    ;//!< Vtable of vb
+	d3d9_index_buffer_vtbl_t  ibVtbl                    ;//!< Vtable of ib
+	u08                     * mem[ TEST_INSTANCES ]     ;//!< Copies of the buffer
+	u32                       size                      ;//!< Size of the buffer
+	u32                       instance                  ;//!< Copy being written, one per discard
+	u32                       locked                    ;//!< Non-zero while locked
+	u32                       refs                      ;//!< References to the buffer
+	hbool                     check                     ;//!< Check the locks against the records
+	test_record_t             record[ TEST_RECORDS ]    ;//!< Allocations in flight
+	u32                       records                   ;//!< Number of records
+}
+test_device_t; //!< A device whose buffers play the driver
+
+//! The test device of a buffer
+#define TEST_OF( p, member ) ( (test_device_t *)( (u08 *)( p ) - offsetof( test_device_t, member ) ) )
+
+
+/****************************************************************************
+ * Stub buffer
+ ****************************************************************************/
+
+//! Locks the buffer, renaming it on LOCK_DISCARD
+static hresult_t test_lock( test_device_t * dev, u32 offset, u32 size, void ** pp, u32 flags )
+{
+	u32 i;
+
+	TEST_CHECK( !dev->locked );
+	TEST_CHECK( size > 0 && offset < dev->size && size <= dev->size - offset );
+
+	dev->locked = 1;
+
+	if ( flags & D3D9_LOCK_DISCARD )
+	{
+		TEST_CHECK( offset == 0 && size == dev->size );
+
+		dev->instance++;
+
+		// the copy being reused must not be in flight anymore
+		for ( i = 0; dev->check && i < dev->records; i++ )
+		{
+			TEST_CHECK( dev->record[i].instance % TEST_INSTANCES != dev->instance % TEST_INSTANCES );
+		}
+	}
+	else
+	{
+		TEST_CHECK( flags & D3D9_LOCK_NOOVERWRITE );
+
+		for ( i = 0; dev->check && i < dev->records; i++ )
+		{
+			const test_record_t * r = & dev->record[i];
+
+			TEST_CHECK( r->instance != dev->instance
+			         || r->offset + r->bytes <= offset || offset + size <= r->offset );
+		}
+	}
+
+	*pp = dev->mem[ dev->instance % TEST_INSTANCES ] + offset;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_vb_lock(
+	d3d9_vertex_buffer_t * p, u32 offsetToLock, u32 sizeToLock, void ** ppbData, u32 aFlags )
+{
+	return test_lock( TEST_OF( p, vb ), offsetToLock, sizeToLock, ppbData, aFlags );
+}
+
+static hresult_t __stdcall test_ib_lock(
+	d3d9_index_buffer_t * p, u32 offsetToLock, u32 sizeToLock, void ** ppbData, u32 aFlags )
+{
+	return test_lock( TEST_OF( p, ib ), offsetToLock, sizeToLock, ppbData, aFlags );
+}
+
+static hresult_t __stdcall test_vb_unlock( d3d9_vertex_buffer_t * p )
+{
+	TEST_CHECK( TEST_OF( p, vb )->locked );
+
+	TEST_OF( p, vb )->locked = 0;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_ib_unlock( d3d9_index_buffer_t * p )
+{
+	TEST_CHECK( TEST_OF( p, ib )->locked );
+
+	TEST_OF( p, ib )->locked = 0;
+
+	return D3D9_OK;
+}
+
+static u32 __stdcall test_vb_release( d3d9_vertex_buffer_t * p )
+{
+	return --TEST_OF( p, vb )->refs;
+}
+
+static u32 __stdcall test_ib_release( d3d9_index_buffer_t * p )
+{
+	return --TEST_OF( p, ib )->refs;
+}
+
+//! Creates the dynamic buffer of a vertex ring
+static hresult_t __stdcall test_create_vertex_buffer(
+	d3d9_device_t * p, u32 aLength, u32 aUsage, u32 aFVF, d3d9_pool_t aPool,
+	d3d9_vertex_buffer_t ** ppVertexBuffer, handle_t * pSharedHandle )
+{
+	test_device_t * dev = (test_device_t *) p;
+
+	(void) aFVF; (void) pSharedHandle;
+
+	TEST_CHECK( ( aUsage & D3D9_USAGE_DYNAMIC ) && aPool == e_d3d9_pool_default );
+
+	dev->size = aLength;
+	dev->refs = 1;
+
+	*ppVertexBuffer = & dev->vb;
+
+	return D3D9_OK;
+}
+
+//! Creates the dynamic buffer of an index ring
+static hresult_t __stdcall test_create_index_buffer(
+	d3d9_device_t * p, u32 aLength, u32 aUsage, d3d9_format_t aFormat, d3d9_pool_t aPool,
+	d3d9_index_buffer_t ** ppIndexBuffer, handle_t * pSharedHandle )
+{
+	test_device_t * dev = (test_device_t *) p;
+
+	(void) aFormat; (void) pSharedHandle;
+
+	TEST_CHECK( ( aUsage & D3D9_USAGE_DYNAMIC ) && aPool == e_d3d9_pool_default );
+
+	dev->size = aLength;
+	dev->refs = 1;
+
+	*ppIndexBuffer = & dev->ib;
+
+	return D3D9_OK;
+}
+
+//! Creates a device whose buffers are of @p bytes at most
+static d3d9_device_t * test_device_create( test_device_t * dev, u32 bytes )
+{
+	d3d9_device_t * null = d3d9_null_device_create( nullp );
+	u32             i;
+
+	memset( dev, 0, sizeof( test_device_t ) );
+
+	d3d9_fwd_device_init( & dev->fwd, null, nullp );
+
+	null->vtbl->release( null );
+
+	dev->fwd.vtbl.createVertexBuffer = test_create_vertex_buffer;
+	dev->fwd.vtbl.createIndexBuffer  = test_create_index_buffer;
+
+	dev->vb.vtbl         = & dev->vbVtbl;
+	dev->ib.vtbl         = & dev->ibVtbl;
+	dev->vbVtbl.lock     = test_vb_lock;
+	dev->vbVtbl.unlock   = test_vb_unlock;
+	dev->vbVtbl.release  = test_vb_release;
+	dev->ibVtbl.lock     = test_ib_lock;
+	dev->ibVtbl.unlock   = test_ib_unlock;
+	dev->ibVtbl.release  = test_ib_release;
+	dev->check           = hf_true;
+
+	for ( i = 0; i < TEST_INSTANCES; i++ )
+	{
+		dev->mem[i] = (u08 *) malloc( bytes );
+	}
+
+	return & dev->fwd.device;
+}
+
+//! Releases a device & its buffers
+static void test_device_release( test_device_t * dev )
+{
+	u32 i;
+
+	TEST_CHECK( dev->refs == 0 && !dev->locked );
+	TEST_CHECK( dev->fwd.device.vtbl->release( & dev->fwd.device ) == 0 );
+
+	for ( i = 0; i < TEST_INSTANCES; i++ )
+	{
+		free( dev->mem[i] );
+	}
+}
+
+
+/****************************************************************************
+ * Frames
+ ****************************************************************************/
+
+//! Get the byte @p i of the pattern of @p tag
+#define TEST_PATTERN( tag, i ) ( (u08)( (tag) * 2654435761u >> 24 ) ^ (u08)( i ) )
+
+//! The GPU has finished the frames up to @p id: checks their allocations
+//! still hold their pattern, then drops them
+static void test_retire( test_device_t * dev, d3d9_ring_t * ring, u32 id )
+{
+	u32 n = 0;
+	u32 i;
+	u32 k;
+
+	d3d9_ring_retire( ring, id );
+
+	for ( i = 0; i < dev->records; i++ )
+	{
+		const test_record_t * r = & dev->record[i];
+
+		if ( (s32)( r->frame - id ) > 0 )
+		{
+			dev->record[ n++ ] = *r;
+
+			continue;
+		}
+
+		for ( k = 0; k < r->bytes; k++ )
+		{
+			if ( dev->mem[ r->instance % TEST_INSTANCES ][ r->offset + k ] != TEST_PATTERN( r->tag, k ) )
+			{
+				TEST_CHECK( !"allocation overwritten while in flight" );
+
+				break;
+			}
+		}
+	}
+
+	dev->records = n;
+}
+
+/**
+ * Runs @p frames frames of 0 to 5 allocations of @p stride bytes elements
+ * (or 12, 20 & 28 bytes if 0), the GPU finishing frame N at frame
+ * N + @p latency.
+ */
+static void test_frames(
+	test_device_t * dev,
+	d3d9_ring_t   * ring,
+	u32             first,
+	u32             frames,
+	u32             latency,
+	u32             stride,
+	u32             seed )
+{
+	u32 id;
+	u32 i;
+	u32 k;
+
+	for ( id = first; id != first + frames; id++ )
+	{
+		u32 n = test_rand( & seed ) % 6;
+
+		TEST_CHECK( d3d9_ring_begin_frame( ring, id ) );
+
+		for ( i = 0; i < n; i++ )
+		{
+			u32               size  = stride ? stride : ( test_rand( & seed ) % 3 ) * 8 + 12;
+			u32               count = test_rand( & seed ) % ( dev->size / size / 3 ) + 1;
+			u32               tag   = test_rand( & seed );
+			u08             * data;
+			d3d9_ring_alloc_t a;
+			hresult_t         hr    = d3d9_ring_alloc( ring, count, size, & a );
+
+			if ( hr == D3D9_ERR_WASSTILLDRAWING )
+			{
+				// draw what the lock holds, then the ring may discard
+				d3d9_ring_unlock( ring );
+
+				hr = d3d9_ring_alloc( ring, count, size, & a );
+			}
+
+			TEST_CHECK( hr == D3D9_OK );
+
+			if ( D3D9_Failed( hr ) )
+			{
+				continue;
+			}
+
+			TEST_CHECK( dev->locked && a.offset % size == 0 && a.first * size == a.offset );
+			TEST_CHECK( a.offset + count * size <= dev->size );
+			TEST_CHECK( a.data == dev->mem[ dev->instance % TEST_INSTANCES ] + a.offset );
+			TEST_CHECK( dev->records < TEST_RECORDS );
+
+			data = (u08 *) a.data;
+
+			for ( k = 0; k < count * size; k++ )
+			{
+				data[k] = TEST_PATTERN( tag, k );
+			}
+
+			if ( dev->records < TEST_RECORDS )
+			{
+				test_record_t * r = & dev->record[ dev->records++ ];
+
+				r->instance = dev->instance;
+				r->offset   = a.offset;
+				r->bytes    = count * size;
+				r->frame    = id;
+				r->tag      = tag;
+			}
+
+			if ( test_rand( & seed ) % 2 )
+			{
+				d3d9_ring_unlock( ring );
+			}
+		}
+
+		d3d9_ring_end_frame( ring );
+
+		TEST_CHECK( !dev->locked );
+
+		// a latency of 0 to @p latency frames, as a GPU which runs unevenly
+		test_retire( dev, ring, id - test_rand( & seed ) % ( latency + 1 ) );
+	}
+
+	test_retire( dev, ring, first + frames - 1 );
+
+	TEST_CHECK( dev->records == 0 && d3d9_ring_tail( ring ) == ring->head );
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! Frames at every latency, around the wrap of the frame numbers
+static void test_latency( u32 frames, u32 bytes )
+{
+	test_device_t * dev = (test_device_t *) malloc( sizeof( test_device_t ) );
+	d3d9_device_t * d   = test_device_create( dev, bytes );
+	d3d9_ring_t     ring;
+	u32             latency;
+
+	for ( latency = 0; latency < D3D9_RING_FRAMES; latency++ )
+	{
+		TEST_CHECK( d3d9_ring_init_vertex( & ring, d, bytes ) == D3D9_OK );
+
+		test_frames( dev, & ring, 0xffffffffu - frames / 2, frames, latency, 0, latency + 1 );
+
+		printf( "ring: latency %u, %u allocs, %u locks, %u discards, %u wraps, %u still drawing,"
+		        " %u of %u bytes in flight at most\n", latency, ring.stats.allocs, ring.stats.locks,
+		        ring.stats.discards, ring.stats.wraps, ring.stats.failures, ring.stats.highWater, bytes );
+
+		TEST_CHECK( ring.stats.wraps > 0 && ring.stats.discards > 0 );
+
+		d3d9_ring_free( & ring );
+	}
+
+	// indices, 16 & 32 bits
+	TEST_CHECK( d3d9_ring_init_index( & ring, d, bytes, e_d3d9_fmt_index16 ) == D3D9_OK );
+	test_frames( dev, & ring, 1, frames / 4, 2, 2, 99 );
+	d3d9_ring_free( & ring );
+
+	TEST_CHECK( d3d9_ring_init_index( & ring, d, bytes, e_d3d9_fmt_index32 ) == D3D9_OK );
+	test_frames( dev, & ring, 1, frames / 4, 3, 4, 98 );
+	d3d9_ring_free( & ring );
+
+	test_device_release( dev );
+	free( dev );
+}
+
+//! The frame slots are reused once retired, bad allocations are refused
+static void test_frame_slots( void )
+{
+	test_device_t   * dev = (test_device_t *) malloc( sizeof( test_device_t ) );
+	d3d9_device_t   * d   = test_device_create( dev, 4096 );
+	d3d9_ring_t       ring;
+	d3d9_ring_alloc_t a;
+	u32               id;
+	u32               i;
+
+	TEST_CHECK( d3d9_ring_init_vertex( & ring, d, 4096 ) == D3D9_OK );
+
+	// outside of a frame
+	TEST_CHECK( d3d9_ring_alloc( & ring, 1, 16, & a ) == D3D9_ERR_INVALIDCALL );
+
+	for ( i = 0, id = 0xfffffffcu; i < D3D9_RING_FRAMES; i++, id++ )
+	{
+		TEST_CHECK( d3d9_ring_begin_frame( & ring, id ) );
+		TEST_CHECK( d3d9_ring_alloc( & ring, 8, 32, & a ) == D3D9_OK );
+		d3d9_ring_end_frame( & ring );
+	}
+
+	TEST_CHECK( !d3d9_ring_begin_frame( & ring, id ) );
+
+	// a frame which hasn't ended yet stays, and so do those after it
+	TEST_CHECK( d3d9_ring_tail( & ring ) == 0 );
+	d3d9_ring_retire( & ring, 0xfffffffcu );
+	TEST_CHECK( d3d9_ring_tail( & ring ) == 256 );
+	TEST_CHECK( d3d9_ring_begin_frame( & ring, id ) );
+	TEST_CHECK( !d3d9_ring_begin_frame( & ring, id + 1 ) );
+	d3d9_ring_retire( & ring, id );
+	TEST_CHECK( ring.frames == 1 );
+
+	// too large, overflowing, empty: 5 failures with the one outside a frame
+	TEST_CHECK( d3d9_ring_alloc( & ring, 4096, 1, & a ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_ring_alloc( & ring, 0x40000001u, 4, & a ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_ring_alloc( & ring, 0, 4, & a ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( d3d9_ring_alloc( & ring, 4, 0, & a ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( ring.stats.failures == 5 );
+
+	d3d9_ring_end_frame( & ring );
+	d3d9_ring_retire( & ring, id );
+	TEST_CHECK( ring.frames == 0 && d3d9_ring_tail( & ring ) == ring.head );
+
+	d3d9_ring_free( & ring );
+
+	test_device_release( dev );
+	free( dev );
+}
+
+//! Times the allocations of a frame of particles & UI
+static void test_benchmark( u32 frames )
+{
+	test_device_t   * dev = (test_device_t *) malloc( sizeof( test_device_t ) );
+	d3d9_device_t   * d   = test_device_create( dev, 4 << 20 );
+	d3d9_ring_t       ring;
+	d3d9_ring_alloc_t a;
+	u32               seed = 5;
+	u32               id;
+	u32               i;
+	u64               t;
+
+	dev->check = hf_false;
+
+	TEST_CHECK( d3d9_ring_init_vertex( & ring, d, 4 << 20 ) == D3D9_OK );
+
+	t = d3d9_ticks();
+
+	for ( id = 1; id <= frames; id++ )
+	{
+		d3d9_ring_begin_frame( & ring, id );
+
+		for ( i = 0; i < 1000; i++ )
+		{
+			if ( d3d9_ring_alloc( & ring, 4 + test_rand( & seed ) % 60, 24, & a ) != D3D9_OK )
+			{
+				d3d9_ring_unlock( & ring );
+
+				TEST_CHECK( d3d9_ring_alloc( & ring, 4, 24, & a ) == D3D9_OK );
+			}
+
+			if ( i % 16 == 15 )
+			{
+				d3d9_ring_unlock( & ring );
+			}
+		}
+
+		d3d9_ring_end_frame( & ring );
+
+		if ( id > 2 )
+		{
+			d3d9_ring_retire( & ring, id - 2 );
+		}
+	}
+
+	t = d3d9_ticks() - t;
+
+	printf( "ring: %u frames of 1000 allocs, %.1f ns/alloc, %.1f allocs/lock, %u discards, %u wraps\n",
+		frames, test_ms( t ) * 1e6 / ( frames * 1000.0 ), (double) ring.stats.allocs / ring.stats.locks,
+		ring.stats.discards, ring.stats.wraps );
+
+	d3d9_ring_free( & ring );
+
+	test_device_release( dev );
+	free( dev );
+}
+
+int main( int argc, char ** argv )
+{
+	u32 frames = test_arg( argc, argv, 1, 20000 );
+	u32 bytes  = test_arg( argc, argv, 2, 4096 );
+
+	test_frame_slots();
+	test_latency( frames, bytes );
+	test_benchmark( frames / 10 );
+
+	return test_done( "ring" );
+}
@@ -0,0 +1,710 @@
+/*
+ * shim.c : Tests Of D3D9FWD.H & D3D9SHIM.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * The calls reach a stub device which keeps the state the set calls leave
+ * behind and a hash of it at every draw. A frame of calls, as a renderer
+ * setting every state of every draw would make, is played straight into a
+ * stub, through a forwarding device and through the shim: all three must
+ * draw with the same state, and the shim with fewer calls. Reset, state
+ * blocks & d3d9_shim_invalidate() must make the shim forward again.
+ *
+ * The benchmark plays the same frame many times into the stub, with and
+ * without the shim. The stub costs far less than a driver, so the calls
+ * saved count more than the times.
+ *
+ *    shim [frames] [draws per frame]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9NULL.H"
+#include "D3D9SHIM.H"
+#include "TEST.H"
+
+//! The state a stub device keeps
+typedef struct TEST_STATE_T
+{
+	void * texture [ D3D9_SHIM_SAMPLERS ]                          ;//!< SetTexture
+	void * stream  [ D3D9_SHIM_STREAMS ]                           ;//!< SetStreamSource
+	void * indices                                                 ;//!< SetIndices
+	void * vs                                                      ;//!< SetVertexShader
+	void * ps                                                      ;//!< SetPixelShader
+	void * decl                                                    ;//!< SetVertexDeclaration
+	u32    rs      [ D3D9_SHIM_RENDERSTATES ]                      ;//!< SetRenderState
+	u32    ss      [ D3D9_SHIM_SAMPLERS ][ D3D9_SHIM_SAMPLERSTATES ] ;//!< SetSamplerState
+	u32    tss     [ D3D9_SHIM_STAGES ][ D3D9_SHIM_STAGESTATES ]     ;//!< SetTextureStageState
+	u32    offset  [ D3D9_SHIM_STREAMS ]                           ;//!< Offsets of the streams
+	u32    stride  [ D3D9_SHIM_STREAMS ]                           ;//!< Strides of the streams
+	u32    fvf                                                     ;//!< SetFVF
+}
+test_state_t; //!< The state a stub device keeps
+
+//! A stub device: set calls only change its state, draws hash it. The
+//! other calls are forwarded to a null device.
+typedef struct TEST_DEVICE_T
+{
+	d3d9_fwd_device_t   fwd    ;//!< Forwards to the null device, must be first
+	test_state_t        state  ;//!< Current state
+	u32                 sets   ;//!< Set calls received
+	u32                 draws  ;//!< Draw calls received
+	hbool               hash   ;//!< Hash the state at every draw
+	u64               * hashes ;//!< Hash of the state at every draw
+	u32                 count  ;//!< Size of hashes
+}
+test_device_t; //!< A stub device
+
+//! The calls of a recorded frame
+enum test_op_e
+{
+	e_test_rs      = 0, //!< SetRenderState( a, b )
+	e_test_ss      = 1, //!< SetSamplerState( a, b, c )
+	e_test_tss     = 2, //!< SetTextureStageState( a, b, c )
+	e_test_texture = 3, //!< SetTexture( a, b )
+	e_test_stream  = 4, //!< SetStreamSource( a, b, c, 32 )
+	e_test_indices = 5, //!< SetIndices( a )
+	e_test_vs      = 6, //!< SetVertexShader( a )
+	e_test_ps      = 7, //!< SetPixelShader( a )
+	e_test_decl    = 8, //!< SetVertexDeclaration( a )
+	e_test_fvf     = 9, //!< SetFVF( a )
+	e_test_draw    = 10, //!< DrawIndexedPrimitive of a triangles
+	e_test_drawup  = 11, //!< DrawPrimitiveUP of a triangles
+};
+
+//! A recorded call, objects are numbers standing for addresses
+typedef struct TEST_CALL_T
+{
+	u32 op ;//!< e_test_*
+	u32 a  ;//!< First argument
+	u32 b  ;//!< Second argument
+	u32 c  ;//!< Third argument
+}
+test_call_t; //!< A recorded call
+
+//! A recorded frame
+typedef struct TEST_FRAME_T
+{
+	test_call_t * calls ;//!< The calls
+	u32           count ;//!< Number of calls
+	u32           sets  ;//!< Set calls of the 9 categories of the shim
+	u32           draws ;//!< Draw calls
+}
+test_frame_t; //!< A recorded frame
+
+//! Vertices of the user pointer draws
+static const f32 g_test_up[ 3 * 4 ] = { 0 };
+
+//! Get the address an object number stands for, nullp for 0
+#define TEST_OBJECT( T, n ) ( (n) ? (T *)(hf_addr)( 0x10000u + (n) * 64u ) : (T *) nullp )
+
+//! The test device of a device
+#define TEST_DEVICE( p ) ( (test_device_t *)( p ) )
+
+
+/****************************************************************************
+ * Stub device
+ ****************************************************************************/
+
+//! Maps a sampler to its slot, as the shim does
+static u32 test_sampler( u32 sampler )
+{
+	return sampler < 16 ? sampler : 16 + ( sampler - D3D9_DMAPSAMPLER );
+}
+
+//! Hashes the state at a draw
+static void test_draw( test_device_t * dev )
+{
+	const u08 * p = (const u08 *) & dev->state;
+	u64         h = 14695981039346656037ull;
+	u32         i;
+
+	dev->draws++;
+
+	if ( !dev->hash )
+	{
+		return;
+	}
+
+	for ( i = 0; i < sizeof( test_state_t ); i++ )
+	{
+		h = ( h ^ p[i] ) * 1099511628211ull;
+	}
+
+	if ( dev->draws > dev->count )
+	{
+		dev->count  = dev->count ? dev->count * 2 : 1024;
+		dev->hashes = (u64 *) realloc( dev->hashes, dev->count * sizeof( u64 ) );
+	}
+
+	dev->hashes[ dev->draws - 1 ] = h;
+}
+
+static hresult_t __stdcall test_set_render_state(
+	d3d9_device_t * p, d3d9_renderstatetype_t aState, u32 aValue )
+{
+	TEST_DEVICE( p )->state.rs[ aState ] = aValue;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_sampler_state(
+	d3d9_device_t * p, u32 aSampler, d3d9_samplerstatetype_t aType, u32 aValue )
+{
+	TEST_DEVICE( p )->state.ss[ test_sampler( aSampler ) ][ aType ] = aValue;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_texture_stage_state(
+	d3d9_device_t * p, u32 aStage, d3d9_texturestagestatetype_t aType, u32 aValue )
+{
+	TEST_DEVICE( p )->state.tss[ aStage ][ aType ] = aValue;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_texture(
+	d3d9_device_t * p, u32 aStage, d3d9_base_texture_t * pTexture )
+{
+	TEST_DEVICE( p )->state.texture[ test_sampler( aStage ) ] = pTexture;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_stream_source(
+	d3d9_device_t * p, u32 streamNumber, d3d9_vertex_buffer_t * pStreamData,
+	u32 offsetInBytes, u32 aStride )
+{
+	test_state_t * s = & TEST_DEVICE( p )->state;
+
+	s->stream[ streamNumber ] = pStreamData;
+	s->offset[ streamNumber ] = offsetInBytes;
+	s->stride[ streamNumber ] = aStride;
+
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_indices( d3d9_device_t * p, d3d9_index_buffer_t * pIndexData )
+{
+	TEST_DEVICE( p )->state.indices = pIndexData;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_vertex_shader( d3d9_device_t * p, d3d9_vertex_shader_t * pShader )
+{
+	TEST_DEVICE( p )->state.vs = pShader;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_pixel_shader( d3d9_device_t * p, d3d9_pixel_shader_t * pShader )
+{
+	TEST_DEVICE( p )->state.ps = pShader;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_set_vertex_declaration(
+	d3d9_device_t * p, d3d9_vertex_declaration_t * pDecl )
+{
+	TEST_DEVICE( p )->state.decl = pDecl;
+	TEST_DEVICE( p )->state.fvf  = 0;
+	TEST_DEVICE( p )->sets++;
+
+	return D3D9_OK;
+}
+
+//! SetFVF replaces the declaration
+static hresult_t __stdcall test_set_fvf( d3d9_device_t * p, u32 aFVF )
+{
+	TEST_DEVICE( p )->state.decl = nullp;
+	TEST_DEVICE( p )->state.fvf  = aFVF;
+
+	return D3D9_OK;
+}
+
+static hresult_t __stdcall test_draw_indexed_primitive(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, int baseVertexIndex,
+	u32 minVertexIndex, u32 numVertices, u32 startIndex, u32 primCount )
+{
+	(void) primitiveType; (void) baseVertexIndex; (void) minVertexIndex;
+	(void) numVertices; (void) startIndex; (void) primCount;
+
+	test_draw( TEST_DEVICE( p ) );
+
+	return D3D9_OK;
+}
+
+//! DrawPrimitiveUP unbinds stream 0
+static hresult_t __stdcall test_draw_primitive_up(
+	d3d9_device_t * p, d3d9_primitivetype_t primitiveType, u32 primitiveCount,
+	const void * pVertexStreamZeroData, u32 aVertexStreamZeroStride )
+{
+	test_state_t * s = & TEST_DEVICE( p )->state;
+
+	(void) primitiveType; (void) primitiveCount;
+	(void) pVertexStreamZeroData; (void) aVertexStreamZeroStride;
+
+	test_draw( TEST_DEVICE( p ) );
+
+	s->stream[0] = nullp;
+	s->offset[0] = 0;
+	s->stride[0] = 0;
+
+	return D3D9_OK;
+}
+
+//! Reset returns the state to its defaults
+static hresult_t __stdcall test_reset( d3d9_device_t * p, d3d9_present_parameters_t * pp )
+{
+	d3d9_device_t * t = TEST_DEVICE( p )->fwd.target;
+
+	memset( & TEST_DEVICE( p )->state, 0, sizeof( test_state_t ) );
+
+	return t->vtbl->reset( t, pp );
+}
+
+//! Creates a stub device in front of a null device
+static d3d9_device_t * test_device_create( test_device_t * dev )
+{
+	d3d9_device_t      * null = d3d9_null_device_create( nullp );
+	d3d9_device_vtbl_t * v    = & dev->fwd.vtbl;
+
+	memset( dev, 0, sizeof( test_device_t ) );
+
+	d3d9_fwd_device_init( & dev->fwd, null, nullp );
+
+	null->vtbl->release( null );
+
+	v->setRenderState         = test_set_render_state;
+	v->setSamplerState        = test_set_sampler_state;
+	v->setTextureStageState   = test_set_texture_stage_state;
+	v->setTexture             = test_set_texture;
+	v->setStreamSource        = test_set_stream_source;
+	v->setIndices             = test_set_indices;
+	v->setVertexShader        = test_set_vertex_shader;
+	v->setPixelShader         = test_set_pixel_shader;
+	v->setVertexDeclaration   = test_set_vertex_declaration;
+	v->setFVF                 = test_set_fvf;
+	v->drawIndexedPrimitive   = test_draw_indexed_primitive;
+	v->drawPrimitiveUP        = test_draw_primitive_up;
+	v->reset                  = test_reset;
+
+	return & dev->fwd.device;
+}
+
+//! Forgets what a stub device has seen
+static void test_device_clear( test_device_t * dev )
+{
+	memset( & dev->state, 0, sizeof( test_state_t ) );
+
+	dev->sets  = 0;
+	dev->draws = 0;
+}
+
+
+/****************************************************************************
+ * Frames
+ ****************************************************************************/
+
+//! Appends a call to a frame
+static void test_call( test_frame_t * f, u32 op, u32 a, u32 b, u32 c )
+{
+	test_call_t * call = & f->calls[ f->count++ ];
+
+	call->op = op;
+	call->a  = a;
+	call->b  = b;
+	call->c  = c;
+
+	f->sets  += op < e_test_fvf;
+	f->draws += op >= e_test_draw;
+}
+
+//! Records a frame of @p draws draws of 24 materials & 64 meshes, in runs
+//! of a material as a roughly sorted scene gives. Every draw sets all of
+//! its state, every 50th draw is a user pointer draw of the UI.
+static void test_frame( test_frame_t * f, u32 draws )
+{
+	u32 seed = 1;
+	u32 mat  = 0;
+	u32 i;
+	u32 k;
+
+	f->calls = (test_call_t *) malloc( (size_t) draws * 40 * sizeof( test_call_t ) );
+	f->count = 0;
+	f->sets  = 0;
+	f->draws = 0;
+
+	for ( i = 0; i < draws; i++ )
+	{
+		u32 mesh = test_rand( & seed ) % 64;
+
+		if ( test_rand( & seed ) % 8 == 0 )
+		{
+			mat = test_rand( & seed ) % 24;
+		}
+
+		if ( i % 50 == 49 )
+		{
+			test_call( f, e_test_rs, e_d3d9_rs_zenable, 0, 0 );
+			test_call( f, e_test_rs, e_d3d9_rs_alphablendenable, 1, 0 );
+			test_call( f, e_test_vs, 0, 0, 0 );
+			test_call( f, e_test_ps, 0, 0, 0 );
+			test_call( f, e_test_fvf, D3D9_FVF_XYZ | D3D9_FVF_DIFFUSE, 0, 0 );
+			test_call( f, e_test_texture, 0, 0, 0 );
+			test_call( f, e_test_drawup, 1, 0, 0 );
+		}
+
+		test_call( f, e_test_vs, 1 + mat % 6, 0, 0 );
+		test_call( f, e_test_ps, 1 + mat % 12, 0, 0 );
+		test_call( f, e_test_decl, 1 + mesh % 3, 0, 0 );
+
+		for ( k = 0; k < 3; k++ )
+		{
+			test_call( f, e_test_texture, k, 100 + mat * 3 + k, 0 );
+			test_call( f, e_test_ss, k, e_d3d9_samp_minfilter, mat % 5 ? 2 : 1 );
+			test_call( f, e_test_ss, k, e_d3d9_samp_magfilter, mat % 5 ? 2 : 1 );
+			test_call( f, e_test_ss, k, e_d3d9_samp_mipfilter, 2 );
+			test_call( f, e_test_ss, k, e_d3d9_samp_addressu, 1 + mat % 2 );
+			test_call( f, e_test_ss, k, e_d3d9_samp_addressv, 1 + mat % 2 );
+		}
+
+		test_call( f, e_test_texture, D3D9_VERTEXTEXTURESAMPLER0, mat % 4 ? 0 : 200 + mat, 0 );
+
+		test_call( f, e_test_rs, e_d3d9_rs_zenable, 1, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_zwriteenable, mat % 4 != 3, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_alphablendenable, mat % 4 == 3, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_srcblend, 5, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_destblend, 6, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_cullmode, mat % 7 ? 3 : 1, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_alphatestenable, mat % 5 == 1, 0 );
+		test_call( f, e_test_rs, e_d3d9_rs_alpharef, 128, 0 );
+		test_call( f, e_test_tss, 0, e_d3d9_tss_colorop, 4 );
+		test_call( f, e_test_tss, 0, e_d3d9_tss_colorarg1, 2 );
+		test_call( f, e_test_tss, 0, e_d3d9_tss_alphaop, mat % 4 == 3 ? 4 : 2 );
+		test_call( f, e_test_stream, 0, 300 + mesh, ( mesh % 2 ) * 1024 );
+		test_call( f, e_test_stream, 1, mat % 3 ? 0 : 400 + mesh, 0 );
+		test_call( f, e_test_indices, 500 + mesh, 0, 0 );
+		test_call( f, e_test_draw, 100 + mesh, 0, 0 );
+	}
+}
+
+//! Plays a frame into a device
+static void test_play( const test_frame_t * f, d3d9_device_t * d )
+{
+	const test_call_t * call = f->calls;
+	const test_call_t * end  = f->calls + f->count;
+
+	for ( ; call < end; call++ )
+	{
+		switch ( (enum test_op_e) call->op )
+		{
+		case e_test_rs:
+			d->vtbl->setRenderState( d, (d3d9_renderstatetype_t) call->a, call->b );
+			break;
+
+		case e_test_ss:
+			d->vtbl->setSamplerState( d, call->a, (d3d9_samplerstatetype_t) call->b, call->c );
+			break;
+
+		case e_test_tss:
+			d->vtbl->setTextureStageState( d, call->a, (d3d9_texturestagestatetype_t) call->b, call->c );
+			break;
+
+		case e_test_texture:
+			d->vtbl->setTexture( d, call->a, TEST_OBJECT( d3d9_base_texture_t, call->b ) );
+			break;
+
+		case e_test_stream:
+			d->vtbl->setStreamSource( d, call->a, TEST_OBJECT( d3d9_vertex_buffer_t, call->b ), call->c,
+			                          call->b ? 32 : 0 );
+			break;
+
+		case e_test_indices:
+			d->vtbl->setIndices( d, TEST_OBJECT( d3d9_index_buffer_t, call->a ) );
+			break;
+
+		case e_test_vs:
+			d->vtbl->setVertexShader( d, TEST_OBJECT( d3d9_vertex_shader_t, call->a ) );
+			break;
+
+		case e_test_ps:
+			d->vtbl->setPixelShader( d, TEST_OBJECT( d3d9_pixel_shader_t, call->a ) );
+			break;
+
+		case e_test_decl:
+			d->vtbl->setVertexDeclaration( d, TEST_OBJECT( d3d9_vertex_declaration_t, call->a ) );
+			break;
+
+		case e_test_fvf:
+			d->vtbl->setFVF( d, call->a );
+			break;
+
+		case e_test_draw:
+			d->vtbl->drawIndexedPrimitive( d, e_d3d9_pt_trianglelist, 0, 0, 3 * call->a, 0, call->a );
+			break;
+
+		case e_test_drawup:
+			d->vtbl->drawPrimitiveUP( d, e_d3d9_pt_trianglelist, call->a, g_test_up, 16 );
+			break;
+		}
+	}
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! The forwarding device fills its whole vtable and reaches its target
+static void test_fwd( void )
+{
+	const d3d9_device_vtbl_t * v     = d3d9_fwd_device_vtbl();
+	void * const             * slots = (void * const *) v;
+	d3d9_device_t            * null  = d3d9_null_device_create( nullp );
+	d3d9_fwd_device_t          fwd;
+	d3d9_device_t            * d     = & fwd.device;
+	d3d9_vertex_buffer_t     * vb    = nullp;
+	d3d9_surface_t           * bb0   = nullp;
+	d3d9_surface_t           * bb1   = nullp;
+	d3d9_null_stats_t          stats;
+	void                     * bits  = nullp;
+	u32                        i;
+
+	for ( i = 0; i < sizeof( d3d9_device_vtbl_t ) / sizeof( void * ); i++ )
+	{
+		TEST_CHECK( slots[i] != nullp );
+	}
+
+	d3d9_fwd_device_init( & fwd, null, nullp );
+
+	TEST_CHECK( d3d9_fwd_device_target( d ) == null );
+	TEST_CHECK( null->vtbl->addRef( null ) == 3 );
+	null->vtbl->release( null );
+
+	TEST_CHECK( d->vtbl->createVertexBuffer( d, 256, 0, 0, e_d3d9_pool_managed, & vb, nullp ) == D3D9_OK );
+	TEST_CHECK( vb && vb->vtbl->lock( vb, 0, 0, & bits, 0 ) == D3D9_OK && bits );
+	TEST_CHECK( d->vtbl->drawPrimitive( d, e_d3d9_pt_trianglelist, 0, 7 ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->present( d, nullp, nullp, 0, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->getBackBuffer( d, 0, 0, e_d3d9_backbuffer_type_mono, & bb0 ) == D3D9_OK );
+	TEST_CHECK( null->vtbl->getBackBuffer( null, 0, 0, e_d3d9_backbuffer_type_mono, & bb1 ) == D3D9_OK );
+	TEST_CHECK( bb0 && bb0 == bb1 );
+
+	d3d9_null_device_get_stats( null, & stats );
+
+	TEST_CHECK( stats.draws == 1 && stats.primitives == 7 && stats.presents == 1 );
+	TEST_CHECK( stats.locks == 1 && stats.objects == 1 );
+
+	bb0->vtbl->release( bb0 );
+	bb1->vtbl->release( bb1 );
+	vb->vtbl->release( vb );
+
+	TEST_CHECK( d->vtbl->addRef( d ) == 2 );
+	TEST_CHECK( d->vtbl->release( d ) == 1 );
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+
+	// the wrapper gave its reference to the null device back
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+}
+
+//! Straight, forwarded & shimmed frames draw with the same state
+static void test_same_state( const test_frame_t * f )
+{
+	test_device_t       a;
+	test_device_t       b;
+	test_device_t       c;
+	d3d9_device_t     * da   = test_device_create( & a );
+	d3d9_device_t     * db   = test_device_create( & b );
+	d3d9_device_t     * dc   = test_device_create( & c );
+	d3d9_fwd_device_t   fwd;
+	d3d9_shim_t       * shim = d3d9_shim_create( dc );
+	d3d9_device_t     * ds   = d3d9_shim_device( shim );
+	d3d9_shim_stats_t   st;
+	u32                 filtered  = 0;
+	u32                 forwarded = 0;
+	u32                 i;
+
+	d3d9_fwd_device_init( & fwd, db, nullp );
+
+	a.hash = b.hash = c.hash = hf_true;
+
+	// twice, the second frame starts with the state of the first
+	for ( i = 0; i < 2; i++ )
+	{
+		test_play( f, da );
+		test_play( f, & fwd.device );
+		test_play( f, ds );
+	}
+
+	TEST_CHECK( a.draws == 2 * f->draws && b.draws == a.draws && c.draws == a.draws );
+	TEST_CHECK( a.sets == 2 * f->sets && b.sets == a.sets );
+	TEST_CHECK( !memcmp( a.hashes, b.hashes, a.draws * sizeof( u64 ) ) );
+	TEST_CHECK( !memcmp( a.hashes, c.hashes, a.draws * sizeof( u64 ) ) );
+	TEST_CHECK( c.sets < a.sets / 2 );
+
+	d3d9_shim_get_stats( shim, & st );
+
+	for ( i = 0; i < e_d3d9_shim_categories; i++ )
+	{
+		filtered  += st.category[i].filtered;
+		forwarded += st.category[i].forwarded;
+	}
+
+	TEST_CHECK( forwarded == c.sets && filtered + forwarded == a.sets );
+
+	printf( "shim: %u set calls of %u draws, %u forwarded (%.1f%%)\n",
+		a.sets, a.draws, forwarded, 100.0 * forwarded / a.sets );
+
+	for ( i = 0; i < e_d3d9_shim_categories; i++ )
+	{
+		printf( "    %-18s %7u filtered %7u forwarded\n", d3d9_shim_category_string( i ),
+			st.category[i].filtered, st.category[i].forwarded );
+	}
+
+	ds->vtbl->release( ds );
+	fwd.device.vtbl->release( & fwd.device );
+
+	// each stub has its own reference left
+	TEST_CHECK( da->vtbl->release( da ) == 0 );
+	TEST_CHECK( db->vtbl->release( db ) == 0 );
+	TEST_CHECK( dc->vtbl->release( dc ) == 0 );
+
+	free( a.hashes );
+	free( b.hashes );
+	free( c.hashes );
+}
+
+//! Reset, state blocks & invalidation make the shim forward again
+static void test_invalidation( void )
+{
+	test_device_t               dev;
+	d3d9_device_t             * stub = test_device_create( & dev );
+	d3d9_shim_t               * shim = d3d9_shim_create( stub );
+	d3d9_device_t             * d    = d3d9_shim_device( shim );
+	d3d9_state_block_t        * sb   = nullp;
+	d3d9_state_block_t        * rec  = nullp;
+	d3d9_present_parameters_t   pp;
+
+	memset( & pp, 0, sizeof( pp ) );
+
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	d->vtbl->setTexture( d, 0, TEST_OBJECT( d3d9_base_texture_t, 1 ) );
+	d->vtbl->setTexture( d, 0, TEST_OBJECT( d3d9_base_texture_t, 1 ) );
+	d->vtbl->setIndices( d, TEST_OBJECT( d3d9_index_buffer_t, 1 ) );
+	d->vtbl->setStreamSource( d, 0, TEST_OBJECT( d3d9_vertex_buffer_t, 1 ), 0, 32 );
+	TEST_CHECK( dev.sets == 4 );
+
+	// user pointer draws unbind stream 0 & the indices
+	d->vtbl->drawIndexedPrimitiveUP( d, e_d3d9_pt_trianglelist, 0, 3, 1, g_test_up, e_d3d9_fmt_index16,
+	                                 g_test_up, 16 );
+	d->vtbl->setIndices( d, TEST_OBJECT( d3d9_index_buffer_t, 1 ) );
+	d->vtbl->setStreamSource( d, 0, TEST_OBJECT( d3d9_vertex_buffer_t, 1 ), 0, 32 );
+	TEST_CHECK( dev.sets == 6 );
+
+	TEST_CHECK( d->vtbl->reset( d, & pp ) == D3D9_OK );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	TEST_CHECK( dev.sets == 7 );
+
+	TEST_CHECK( d->vtbl->createStateBlock( d, e_d3d9_sbt_all, & sb ) == D3D9_OK && sb );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	TEST_CHECK( dev.sets == 7 );
+	TEST_CHECK( sb->vtbl->apply( sb ) == D3D9_OK );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	TEST_CHECK( dev.sets == 8 );
+
+	// recorded, not executed: every set goes to the device
+	TEST_CHECK( d->vtbl->beginStateBlock( d ) == D3D9_OK );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	TEST_CHECK( d->vtbl->endStateBlock( d, & rec ) == D3D9_OK && rec );
+	TEST_CHECK( dev.sets == 10 );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	TEST_CHECK( dev.sets == 10 );
+
+	d3d9_shim_invalidate( shim );
+	d->vtbl->setRenderState( d, e_d3d9_rs_zenable, 1 );
+	TEST_CHECK( dev.sets == 11 );
+
+	// the state blocks hold the shim, the shim holds the stub
+	sb->vtbl->release( sb );
+	rec->vtbl->release( rec );
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+	TEST_CHECK( stub->vtbl->release( stub ) == 0 );
+}
+
+//! Plays @p frames frames into the stub, with & without the shim
+static void test_benchmark( const test_frame_t * f, u32 frames )
+{
+	test_device_t   dev;
+	d3d9_device_t * stub = test_device_create( & dev );
+	d3d9_shim_t   * shim = d3d9_shim_create( stub );
+	d3d9_device_t * d    = d3d9_shim_device( shim );
+	u64             t0;
+	u64             t1;
+	u64             t2;
+	u32             direct;
+	u32             i;
+
+	t0 = d3d9_ticks();
+
+	for ( i = 0; i < frames; i++ )
+	{
+		test_play( f, stub );
+	}
+
+	t1     = d3d9_ticks();
+	direct = dev.sets;
+
+	test_device_clear( & dev );
+
+	for ( i = 0; i < frames; i++ )
+	{
+		test_play( f, d );
+	}
+
+	t2 = d3d9_ticks();
+
+	printf( "shim: %u frames of %u calls, stub %.1f ns/call, shim & stub %.1f ns/call,"
+	        " %u of %u sets reach the stub\n", frames, f->count,
+		test_ms( t1 - t0 ) * 1e6 / ( (double) frames * f->count ),
+		test_ms( t2 - t1 ) * 1e6 / ( (double) frames * f->count ),
+		dev.sets / frames, direct / frames );
+
+	d->vtbl->release( d );
+	stub->vtbl->release( stub );
+}
+
+int main( int argc, char ** argv )
+{
+	u32          frames = test_arg( argc, argv, 1, 200 );
+	u32          draws  = test_arg( argc, argv, 2, 2000 );
+	test_frame_t f;
+
+	test_frame( & f, draws );
+
+	test_fwd();
+	test_same_state( & f );
+	test_invalidation();
+	test_benchmark( & f, frames );
+
+	free( f.calls );
+
+	return test_done( "shim" );
+}
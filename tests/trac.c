@@ -0,0 +1,712 @@
+/*
+ * trac.c : Tests & Benchmark Of D3D9TRAC.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * A scene of 10 frames, with buffers, a texture, a declaration, a shader,
+ * a state block & the back buffer, is played on a null device, then
+ * captured in front of another and replayed into a third: the three must
+ * count the same 10 draws of 55 primitives, 10 presents & 20 locks, the
+ * replay must neither fail nor skip a record, and no object may be left
+ * alive once the trace has released them. The same capture through a
+ * writer thread which keeps the buffers in flight gives the same trace.
+ *
+ * Damaged traces: a record using an object of the wrong kind is skipped,
+ * buffer & texture data past the end of their object fail, and so do the
+ * locks of the null device past the end of a buffer. A trace cut short
+ * replays up to the cut.
+ *
+ * Also times the scene played directly, captured & replayed.
+ *
+ *    trac [benchmark frames]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9NULL.H"
+#include "D3D9TRAC.H"
+#include "TEST.H"
+
+//! Frames of the scene checked
+#define TEST_FRAMES 10
+
+//! A trace in memory, copied by the sink or by a writer thread
+typedef struct TEST_SINK_T
+{
+	u08             * data     ;//!< The trace
+	u64               bytes    ;//!< Size of the trace
+	u64               capacity ;//!< Size of data
+	d3d9_trace_t    * trace    ;//!< Capture whose buffers the writer returns
+	const void      * queue[2] ;//!< Buffers in flight, oldest first
+	u32               sizes[2] ;//!< Their sizes
+	u32               queued   ;//!< Number of buffers in flight
+	u32               most     ;//!< Most buffers in flight at once
+	hbool             writer   ;//!< Buffers are copied by the writer thread
+	hbool             quit     ;//!< Stops the writer thread
+	pthread_mutex_t   mutex    ;//!< Guards the queue
+	pthread_cond_t    cond     ;//!< Signals the queue
+}
+test_sink_t; //!< A trace in memory, copied by the sink or by a writer thread
+
+//! Counters of a scene on the null device & of its replay
+typedef struct TEST_RUN_T
+{
+	d3d9_null_stats_t   null   ;//!< Counters of the null device
+	d3d9_replay_stats_t replay ;//!< Counters of the replay
+	u64                 ticks  ;//!< Time taken
+}
+test_run_t; //!< Counters of a scene on the null device & of its replay
+
+//! vs_3_0 bytecode: mov oPos, v0
+static const u32 g_test_vs[] =
+{
+	0xFFFE0300u, 0x0002FFFEu, 1, 2, 0x02000001u, 0x800F0000u, 0x90E40000u, 0x0000FFFFu
+};
+
+
+/****************************************************************************
+ * Sink
+ ****************************************************************************/
+
+//! Appends data to the trace in memory
+static void test_sink_write( test_sink_t * s, const void * data, u32 bytes )
+{
+	if ( s->bytes + bytes > s->capacity )
+	{
+		s->capacity = ( s->bytes + bytes ) * 2;
+		s->data     = (u08 *) realloc( s->data, (size_t) s->capacity );
+	}
+
+	memcpy( s->data + s->bytes, data, bytes );
+
+	s->bytes += bytes;
+}
+
+//! Copies a buffer, or queues it for the writer thread and keeps it in flight
+static hbool test_sink( void * user, const void * data, u32 bytes )
+{
+	test_sink_t * s = (test_sink_t *) user;
+
+	if ( !s->writer )
+	{
+		test_sink_write( s, data, bytes );
+
+		return hf_true;
+	}
+
+	pthread_mutex_lock( & s->mutex );
+
+	TEST_CHECK( s->queued < 2 );
+
+	s->queue[ s->queued ] = data;
+	s->sizes[ s->queued ] = bytes;
+	s->queued++;
+	s->most = s->queued > s->most ? s->queued : s->most;
+
+	pthread_cond_signal( & s->cond );
+	pthread_mutex_unlock( & s->mutex );
+
+	return hf_false;
+}
+
+//! Copies the buffers in flight & returns them to the capture
+static void * test_writer( void * arg )
+{
+	test_sink_t * s = (test_sink_t *) arg;
+
+	pthread_mutex_lock( & s->mutex );
+
+	while ( !s->quit || s->queued )
+	{
+		const void * data;
+
+		if ( !s->queued )
+		{
+			pthread_cond_wait( & s->cond, & s->mutex );
+
+			continue;
+		}
+
+		data = s->queue[0];
+
+		pthread_mutex_unlock( & s->mutex );
+
+		test_sink_write( s, data, s->sizes[0] );
+
+		pthread_mutex_lock( & s->mutex );
+
+		s->queue[0] = s->queue[1];
+		s->sizes[0] = s->sizes[1];
+		s->queued--;
+
+		d3d9_trace_done( s->trace, data );
+	}
+
+	pthread_mutex_unlock( & s->mutex );
+
+	return nullp;
+}
+
+//! Get the offset of the arguments of the @p nth record of @p op, 0 if none
+static u64 test_find( const test_sink_t * s, u32 op, u32 nth )
+{
+	d3d9_replay_t     rp;
+	d3d9_trace_call_t call;
+	u64               at = 0;
+
+	TEST_CHECK( d3d9_replay_init( & rp, s->data, s->bytes, nullp ) == D3D9_OK );
+
+	while ( d3d9_replay_next( & rp, & call ) )
+	{
+		if ( call.op == op && nth-- == 0 )
+		{
+			at = (u64)( (const u08 *) call.args - s->data );
+
+			break;
+		}
+	}
+
+	d3d9_replay_free( & rp );
+
+	TEST_CHECK( at != 0 );
+
+	return at;
+}
+
+
+/****************************************************************************
+ * Scene
+ ****************************************************************************/
+
+/**
+ * Plays @p frames frames, each of a dynamic buffer & a texture refilled,
+ * and of one draw of as many primitives as its number, from buffers on
+ * even frames & from memory on odd ones. Flushes @p trace after each
+ * present if given.
+ */
+static void test_scene( d3d9_device_t * d, u32 frames, d3d9_trace_t * trace )
+{
+	d3d9_vertexelement_t        el[] =
+	{
+		{ 0, 0, e_d3d9_decltype_float3, 0, e_d3d9_declusage_position, 0 },
+		{ 0xFF, 0, e_d3d9_decltype_unused, 0, 0, 0 }, // D3DDECL_END
+	};
+	d3d9_vertex_buffer_t      * vb   = nullp;
+	d3d9_vertex_buffer_t      * dyn  = nullp;
+	d3d9_index_buffer_t       * ib   = nullp;
+	d3d9_texture_t            * tex  = nullp;
+	d3d9_vertex_declaration_t * decl = nullp;
+	d3d9_vertex_shader_t      * vs   = nullp;
+	d3d9_state_block_t        * sb   = nullp;
+	d3d9_surface_t            * bb   = nullp;
+	d3d9_locked_rect_t          lr;
+	f32                         m[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+	f32                         up[ TEST_FRAMES * 9 ];
+	void                      * p;
+	u32                         f;
+	u32                         i;
+
+	for ( i = 0; i < TEST_FRAMES * 9; i++ )
+	{
+		up[i] = (f32) i;
+	}
+
+	TEST_CHECK( d->vtbl->createVertexBuffer( d, 4096, 0, 0, e_d3d9_pool_managed, & vb, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createVertexBuffer( d, 1024, D3D9_USAGE_DYNAMIC, 0, e_d3d9_pool_default, & dyn, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createIndexBuffer( d, 600, 0, e_d3d9_fmt_index16, e_d3d9_pool_managed, & ib, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createTexture( d, 64, 64, 1, 0, e_d3d9_fmt_a8r8g8b8, e_d3d9_pool_managed, & tex, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createVertexDeclaration( d, el, & decl ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createVertexShader( d, g_test_vs, & vs ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createStateBlock( d, e_d3d9_sbt_all, & sb ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->getBackBuffer( d, 0, 0, e_d3d9_backbuffer_type_mono, & bb ) == D3D9_OK );
+
+	if ( !vb || !dyn || !ib || !tex || !decl || !vs || !sb || !bb )
+	{
+		return;
+	}
+
+	for ( f = 0; f < frames; f++ )
+	{
+		d->vtbl->beginScene( d );
+		d->vtbl->setRenderTarget( d, 0, bb );
+		d->vtbl->clear( d, 0, nullp, D3D9_CLEAR_TARGET, 0xFF000000u, 1.0f, 0 );
+
+		if ( dyn->vtbl->lock( dyn, 0, 0, & p, D3D9_LOCK_DISCARD ) == D3D9_OK )
+		{
+			memset( p, (int)( f & 3 ), 1024 );
+			dyn->vtbl->unlock( dyn );
+		}
+
+		if ( tex->vtbl->lockRect( tex, 0, & lr, nullp, 0 ) == D3D9_OK )
+		{
+			for ( i = 0; i < 64; i++ )
+			{
+				memset( (u08 *) lr.pBits + lr.pitch * i, (int)( i + f ), 256 );
+			}
+
+			tex->vtbl->unlockRect( tex, 0 );
+		}
+
+		sb->vtbl->apply( sb );
+
+		m[12] = (f32) f;
+
+		d->vtbl->setTransform( d, e_d3d9_ts_view, (const d3d9_matrix_t *) m );
+		d->vtbl->setVertexShaderConstantF( d, 0, m, 4 );
+		d->vtbl->setRenderState( d, e_d3d9_rs_zenable, f & 1 );
+		d->vtbl->setVertexDeclaration( d, decl );
+		d->vtbl->setVertexShader( d, vs );
+		d->vtbl->setTexture( d, 0, (d3d9_base_texture_t *) tex );
+
+		if ( f % 2 == 0 )
+		{
+			d->vtbl->setStreamSource( d, 0, vb, 0, 12 );
+			d->vtbl->setIndices( d, ib );
+			d->vtbl->drawIndexedPrimitive( d, e_d3d9_pt_trianglelist, 0, 0, 100, 0, f % TEST_FRAMES + 1 );
+		}
+		else
+		{
+			d->vtbl->drawPrimitiveUP( d, e_d3d9_pt_trianglelist, f % TEST_FRAMES + 1, up, 12 );
+		}
+
+		d->vtbl->endScene( d );
+		d->vtbl->present( d, nullp, nullp, 0, nullp );
+
+		if ( trace )
+		{
+			d3d9_trace_flush( trace );
+		}
+	}
+
+	bb->vtbl->release( bb );
+	sb->vtbl->release( sb );
+	vs->vtbl->release( vs );
+	decl->vtbl->release( decl );
+	tex->vtbl->release( tex );
+	ib->vtbl->release( ib );
+	dyn->vtbl->release( dyn );
+	vb->vtbl->release( vb );
+}
+
+//! Plays the scene on a null device
+static void test_direct( u32 frames, test_run_t * run )
+{
+	d3d9_device_t * null = d3d9_null_device_create( nullp );
+
+	memset( run, 0, sizeof( test_run_t ) );
+
+	run->ticks = d3d9_ticks();
+
+	test_scene( null, frames, nullp );
+
+	run->ticks = d3d9_ticks() - run->ticks;
+
+	d3d9_null_device_get_stats( null, & run->null );
+
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+}
+
+//! Captures the scene in front of a null device, with or without a writer
+//! thread
+static void test_capture( u32 frames, test_sink_t * s, hbool writer, test_run_t * run )
+{
+	d3d9_trace_desc_t   desc;
+	d3d9_trace_stats_t  stats;
+	d3d9_device_t     * null = d3d9_null_device_create( nullp );
+	d3d9_device_t     * d;
+	pthread_t           thread;
+
+	memset( s, 0, sizeof( test_sink_t ) );
+	memset( run, 0, sizeof( test_run_t ) );
+
+	desc.sink        = test_sink;
+	desc.user        = s;
+	desc.bufferBytes = 0;
+
+	s->trace  = d3d9_trace_create( & desc );
+	s->writer = writer;
+
+	pthread_mutex_init( & s->mutex, nullp );
+	pthread_cond_init( & s->cond, nullp );
+
+	if ( writer )
+	{
+		pthread_create( & thread, nullp, test_writer, s );
+	}
+
+	d = d3d9_trace_device( s->trace, null );
+
+	TEST_CHECK( d != nullp );
+	TEST_CHECK( d3d9_trace_device( s->trace, null ) == nullp );
+
+	run->ticks = d3d9_ticks();
+
+	test_scene( d, frames, s->trace );
+
+	run->ticks = d3d9_ticks() - run->ticks;
+
+	d3d9_null_device_get_stats( null, & run->null );
+
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+
+	d3d9_trace_get_stats( s->trace, & stats );
+	d3d9_trace_free( s->trace );
+
+	if ( writer )
+	{
+		pthread_mutex_lock( & s->mutex );
+		s->quit = hf_true;
+		pthread_cond_signal( & s->cond );
+		pthread_mutex_unlock( & s->mutex );
+
+		pthread_join( thread, nullp );
+	}
+
+	pthread_cond_destroy( & s->cond );
+	pthread_mutex_destroy( & s->mutex );
+
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+	TEST_CHECK( stats.unhooked == 0 && stats.bytes <= s->bytes );
+
+	if ( frames == TEST_FRAMES )
+	{
+		printf( "trac: %s, %llu bytes, %llu records, %llu blobs of %llu bytes, %llu written before"
+		        " (%llu bytes), %u waits, %u buffers in flight at most\n",
+		        writer ? "writer thread" : "sink", (unsigned long long) s->bytes,
+		        (unsigned long long) stats.records, (unsigned long long) stats.blobs,
+		        (unsigned long long) stats.blobBytes, (unsigned long long) stats.dedupBlobs,
+		        (unsigned long long) stats.dedupBytes, stats.waits, s->most );
+	}
+}
+
+//! Replays a trace into a null device, whose objects must all be released
+static void test_replay( const u08 * data, u64 bytes, test_run_t * run )
+{
+	d3d9_device_t * null = d3d9_null_device_create( nullp );
+	d3d9_replay_t   rp;
+
+	memset( run, 0, sizeof( test_run_t ) );
+
+	TEST_CHECK( d3d9_replay_init( & rp, data, bytes, null ) == D3D9_OK );
+
+	run->ticks = d3d9_ticks();
+
+	while ( d3d9_replay_frame( & rp ) )
+	{
+	}
+
+	run->ticks = d3d9_ticks() - run->ticks;
+
+	d3d9_replay_get_stats( & rp, & run->replay );
+	d3d9_replay_free( & rp );
+
+	d3d9_null_device_get_stats( null, & run->null );
+
+	TEST_CHECK( run->null.objects == 0 );
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! Checks the counters of the scene of TEST_FRAMES frames
+static void test_counts( const char * name, const test_run_t * run )
+{
+	const d3d9_null_stats_t * s = & run->null;
+
+	printf( "trac: %s, %u draws of %u primitives, %u presents, %u locks, %u objects left\n",
+		name, s->draws, s->primitives, s->presents, s->locks, s->objects );
+
+	TEST_CHECK( s->draws == 10 && s->primitives == 55 && s->presents == 10 && s->locks == 20 );
+	TEST_CHECK( s->objects == 0 );
+}
+
+//! The scene played, captured & replayed counts the same calls
+static void test_round_trip( void )
+{
+	test_sink_t       s;
+	test_sink_t       w;
+	test_run_t        run;
+	d3d9_replay_t     rp;
+	d3d9_trace_call_t call;
+	u32               ops[ e_d3d9_trace_ops ];
+
+	test_direct( TEST_FRAMES, & run );
+	test_counts( "direct", & run );
+
+	test_capture( TEST_FRAMES, & s, hf_false, & run );
+	test_counts( "captured", & run );
+
+	test_replay( s.data, s.bytes, & run );
+	test_counts( "replayed", & run );
+
+	printf( "trac: replay, %u calls, %u frames, %u failed, %u skipped\n",
+		run.replay.calls, run.replay.frames, run.replay.failed, run.replay.skipped );
+
+	TEST_CHECK( run.replay.frames == TEST_FRAMES );
+	TEST_CHECK( run.replay.failed == 0 && run.replay.skipped == 0 );
+
+	// the records, read only
+	memset( ops, 0, sizeof( ops ) );
+
+	TEST_CHECK( d3d9_replay_init( & rp, s.data, s.bytes, nullp ) == D3D9_OK );
+
+	while ( d3d9_replay_next( & rp, & call ) )
+	{
+		TEST_CHECK( call.op > e_d3d9_trace_blob && call.op < e_d3d9_trace_ops );
+
+		ops[ call.op % e_d3d9_trace_ops ]++;
+
+		TEST_CHECK( d3d9_replay_call( & rp, & call ) == D3D9_OK );
+	}
+
+	d3d9_replay_free( & rp );
+
+	TEST_CHECK( ops[ e_d3d9_trace_drawindexedprimitive ] == 5 && ops[ e_d3d9_trace_drawprimitiveup ] == 5 );
+	TEST_CHECK( ops[ e_d3d9_trace_present ] == TEST_FRAMES );
+	TEST_CHECK( ops[ e_d3d9_trace_vertexbufferdata ] == TEST_FRAMES && ops[ e_d3d9_trace_texturedata ] == TEST_FRAMES );
+	TEST_CHECK( ops[ e_d3d9_trace_release ] == 7 );
+
+	// the same trace through a writer thread, but for the timestamps
+	test_capture( TEST_FRAMES, & w, hf_true, & run );
+	test_counts( "captured by a writer thread", & run );
+
+	TEST_CHECK( w.bytes == s.bytes );
+
+	test_replay( w.data, w.bytes, & run );
+	test_counts( "replayed from the writer thread", & run );
+
+	TEST_CHECK( run.replay.failed == 0 && run.replay.skipped == 0 );
+
+	// cut short: not a trace, then a record cut in half
+	TEST_CHECK( d3d9_replay_init( & rp, s.data, 16, nullp ) != D3D9_OK );
+
+	test_replay( s.data, test_find( & s, e_d3d9_trace_present, 4 ) - 4, & run );
+
+	TEST_CHECK( run.replay.frames == 4 && run.replay.failed == 0 && run.replay.skipped == 0 );
+
+	test_replay( s.data, s.bytes - 3, & run );
+
+	TEST_CHECK( run.replay.frames == TEST_FRAMES && run.replay.failed == 0 );
+
+	free( w.data );
+	free( s.data );
+}
+
+//! Replays the trace with the rect & row bytes of its nth texture data changed
+static void test_texture_rect( const test_sink_t * s, u08 * copy, u32 nth,
+	u32 left, u32 top, u32 right, u32 bottom, u32 size, test_run_t * run )
+{
+	u32 * a;
+
+	memcpy( copy, s->data, (size_t) s->bytes );
+
+	a    = (u32 *)( copy + test_find( s, e_d3d9_trace_texturedata, nth ) );
+	a[3] = 1;
+	a[4] = left;
+	a[5] = top;
+	a[6] = right;
+	a[7] = bottom;
+	a[9] = size;
+
+	test_replay( copy, s->bytes, run );
+
+	printf( "trac: rows of %u bytes into [%u, %u) x [%u, %u) of the %s level, %u skipped, %u failed\n",
+		size, left, right, top, bottom, nth ? "dxt1" : "a8r8g8b8", run->replay.skipped, run->replay.failed );
+
+	TEST_CHECK( run->replay.skipped == 0 );
+}
+
+//! Records of the wrong kind are skipped, data past the end fails
+static void test_damaged( void )
+{
+	test_sink_t            s;
+	test_run_t             run;
+	d3d9_trace_desc_t      desc;
+	d3d9_device_t        * null = d3d9_null_device_create( nullp );
+	d3d9_device_t        * d;
+	d3d9_vertex_buffer_t * big;
+	d3d9_vertex_buffer_t * small;
+	d3d9_index_buffer_t  * ib;
+	d3d9_texture_t       * tex;
+	d3d9_texture_t       * dxt;
+	d3d9_surface_t       * level;
+	d3d9_locked_rect_t     lr;
+	u08                  * copy;
+	u32                  * a;
+	void                 * p;
+	u32                    id;
+
+	memset( & s, 0, sizeof( s ) );
+
+	desc.sink        = test_sink;
+	desc.user        = & s;
+	desc.bufferBytes = 0;
+
+	s.trace = d3d9_trace_create( & desc );
+	d       = d3d9_trace_device( s.trace, null );
+
+	TEST_CHECK( d->vtbl->createVertexBuffer( d, 4096, 0, 0, e_d3d9_pool_managed, & big, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createVertexBuffer( d, 64, 0, 0, e_d3d9_pool_managed, & small, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createIndexBuffer( d, 64, 0, e_d3d9_fmt_index16, e_d3d9_pool_managed, & ib, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createTexture( d, 64, 64, 1, 0, e_d3d9_fmt_a8r8g8b8, e_d3d9_pool_managed, & tex, nullp ) == D3D9_OK );
+	TEST_CHECK( d->vtbl->createTexture( d, 64, 64, 1, 0, e_d3d9_fmt_dxt1, e_d3d9_pool_managed, & dxt, nullp ) == D3D9_OK );
+
+	TEST_CHECK( big->vtbl->lock( big, 0, 0, & p, 0 ) == D3D9_OK );
+	memset( p, 1, 4096 );
+	big->vtbl->unlock( big );
+
+	TEST_CHECK( tex->vtbl->lockRect( tex, 0, & lr, nullp, 0 ) == D3D9_OK );
+	memset( (void *) lr.pBits, 2, (size_t) lr.pitch * 64 );
+	tex->vtbl->unlockRect( tex, 0 );
+
+	// 16 rows of 16 blocks
+	TEST_CHECK( dxt->vtbl->lockRect( dxt, 0, & lr, nullp, 0 ) == D3D9_OK );
+	memset( (void *) lr.pBits, 4, (size_t) lr.pitch * 16 );
+	dxt->vtbl->unlockRect( dxt, 0 );
+
+	TEST_CHECK( tex->vtbl->getSurfaceLevel( tex, 0, & level ) == D3D9_OK );
+	level->vtbl->release( level );
+
+	// the locks of the null device stay within the buffer, 0 locks the rest
+	TEST_CHECK( small->vtbl->lock( small, 0, 4096, & p, 0 ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( small->vtbl->lock( small, 32, 33, & p, 0 ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( small->vtbl->lock( small, 65, 0, & p, 0 ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( ib->vtbl->lock( ib, 0, 65, & p, 0 ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( ib->vtbl->lock( ib, 64, 1, & p, 0 ) == D3D9_ERR_INVALIDCALL );
+	TEST_CHECK( ib->vtbl->lock( ib, 32, 32, & p, 0 ) == D3D9_OK );
+	ib->vtbl->unlock( ib );
+	TEST_CHECK( small->vtbl->lock( small, 32, 0, & p, 0 ) == D3D9_OK );
+	memset( p, 3, 32 );
+	small->vtbl->unlock( small );
+
+	d->vtbl->present( d, nullp, nullp, 0, nullp );
+
+	dxt->vtbl->release( dxt );
+	tex->vtbl->release( tex );
+	ib->vtbl->release( ib );
+	small->vtbl->release( small );
+	big->vtbl->release( big );
+
+	TEST_CHECK( d->vtbl->release( d ) == 0 );
+	TEST_CHECK( null->vtbl->release( null ) == 0 );
+
+	d3d9_trace_free( s.trace );
+
+	test_replay( s.data, s.bytes, & run );
+
+	TEST_CHECK( run.replay.frames == 1 && run.replay.failed == 0 && run.replay.skipped == 0 );
+
+	id   = ( (const u32 *)( s.data + test_find( & s, e_d3d9_trace_createvertexbuffer, 1 ) ) )[0];
+	copy = (u08 *) malloc( (size_t) s.bytes );
+
+	// GetSurfaceLevel of the small vertex buffer
+	memcpy( copy, s.data, (size_t) s.bytes );
+	a    = (u32 *)( copy + test_find( & s, e_d3d9_trace_getsurfacelevel, 0 ) );
+	a[0] = id;
+
+	test_replay( copy, s.bytes, & run );
+
+	printf( "trac: surface level of a vertex buffer, %u skipped, %u failed\n",
+		run.replay.skipped, run.replay.failed );
+
+	TEST_CHECK( run.replay.skipped == 1 && run.replay.failed == 0 );
+
+	// the 4096 bytes of the big buffer into the small one
+	memcpy( copy, s.data, (size_t) s.bytes );
+	a    = (u32 *)( copy + test_find( & s, e_d3d9_trace_vertexbufferdata, 0 ) );
+	a[0] = id;
+
+	test_replay( copy, s.bytes, & run );
+
+	printf( "trac: 4096 bytes into a 64 bytes buffer, %u skipped, %u failed\n",
+		run.replay.skipped, run.replay.failed );
+
+	TEST_CHECK( run.replay.skipped == 0 && run.replay.failed == 1 );
+
+	// the 32 bytes at 32 of the small buffer, at 48
+	memcpy( copy, s.data, (size_t) s.bytes );
+	a    = (u32 *)( copy + test_find( & s, e_d3d9_trace_vertexbufferdata, 1 ) );
+	TEST_CHECK( a[0] == id && a[1] == 32 && a[2] == 32 );
+	a[1] = 48;
+
+	test_replay( copy, s.bytes, & run );
+
+	TEST_CHECK( run.replay.skipped == 0 && run.replay.failed == 1 );
+
+	// the 64 rows of the level, from the row 32
+	memcpy( copy, s.data, (size_t) s.bytes );
+	a    = (u32 *)( copy + test_find( & s, e_d3d9_trace_texturedata, 0 ) );
+	TEST_CHECK( a[3] == 0 && a[8] == 64 );
+	a[3] = 1;
+	a[4] = 0;
+	a[5] = 32;
+	a[6] = 64;
+	a[7] = 96;
+
+	test_replay( copy, s.bytes, & run );
+
+	printf( "trac: 64 rows from the row 32 of 64, %u skipped, %u failed\n",
+		run.replay.skipped, run.replay.failed );
+
+	TEST_CHECK( run.replay.skipped == 0 && run.replay.failed == 1 );
+
+	// rows as wide as the level from the column 48, past the right edge,
+	// an empty rect, then a rect & rows which fit
+	test_texture_rect( & s, copy, 0, 48, 0, 64, 64, 256, & run );
+	TEST_CHECK( run.replay.failed == 1 );
+	test_texture_rect( & s, copy, 0, 0, 0, 128, 64, 256, & run );
+	TEST_CHECK( run.replay.failed == 1 );
+	test_texture_rect( & s, copy, 0, 32, 0, 32, 64, 0, & run );
+	TEST_CHECK( run.replay.failed == 1 );
+	test_texture_rect( & s, copy, 0, 16, 0, 48, 64, 128, & run );
+	TEST_CHECK( run.replay.failed == 0 );
+
+	// the same in blocks: 16 blocks from the block 8, then 8
+	test_texture_rect( & s, copy, 1, 32, 0, 64, 64, 128, & run );
+	TEST_CHECK( run.replay.failed == 1 );
+	test_texture_rect( & s, copy, 1, 32, 0, 64, 64, 64, & run );
+	TEST_CHECK( run.replay.failed == 0 );
+
+	free( copy );
+	free( s.data );
+}
+
+//! Times the scene played directly, captured & replayed
+static void test_benchmark( u32 frames )
+{
+	test_sink_t s;
+	test_run_t  direct;
+	test_run_t  captured;
+	test_run_t  replayed;
+
+	test_direct( frames, & direct );
+	test_capture( frames, & s, hf_false, & captured );
+	test_replay( s.data, s.bytes, & replayed );
+
+	TEST_CHECK( replayed.null.draws == direct.null.draws && replayed.null.locks == direct.null.locks );
+	TEST_CHECK( replayed.replay.failed == 0 && replayed.replay.skipped == 0 );
+
+	printf( "trac: %u frames, %.3f ms direct, %.3f ms captured, %.3f ms replayed, %.1f bytes per frame\n",
+		frames, test_ms( direct.ticks ), test_ms( captured.ticks ), test_ms( replayed.ticks ),
+		(double) s.bytes / frames );
+
+	free( s.data );
+}
+
+int main( int argc, char ** argv )
+{
+	u32 frames = test_arg( argc, argv, 1, 2000 );
+
+	test_round_trip();
+	test_damaged();
+	test_benchmark( frames );
+
+	return test_done( "trac" );
+}
@@ -0,0 +1,793 @@
+/*
+ * vpak.c : Tests Of D3D9VPAK.H.
+ *
+ * Created on: 17 oct 2026
+ * Updated on: 17 oct 2026
+ *     Author: Martin Andreasson
+ *    Version: 1.0
+ *    License: Mozilla Public License Version 2.0
+ *
+ * Each declaration type is packed & unpacked next to a neighbour of its
+ * stream and an element of another stream, for counts which end inside a
+ * chunk & inside a SIMD group. The bits of the packed fields are read here
+ * and compared to a reference of the type: scaled, clamped & rounded to
+ * nearest, half away from zero, NaN to the lowest value. Missing input
+ * components must pack as (0, 0, 0, 1) and missing type components must
+ * unpack so. Random bytes are unpacked too, for the fields no packing
+ * writes, i.e. -32768 of SHORT2N, seen as -1. Every instruction set, and
+ * threads, must write the bytes and floats of the scalar kernels.
+ *
+ * The round trip error of each type is checked against half its step, or
+ * against the precision of a half, and printed. Then the compilation of
+ * declarations is checked, and a vertex of 8 elements is packed, one
+ * vertex & element at a time as a loader would, then by the plan with
+ * each instruction set & on threads.
+ *
+ *    vpak [benchmark vertices] [threads]
+ */
+
+#define D3D9LDR_IMPLEMENTATION
+#include "D3D9LDR.H"
+#include "D3D9VPAK.H"
+#include "TEST.H"
+
+#include <math.h>
+
+//! Kinds of declaration types
+enum
+{
+	e_test_float = 0, //!< Floats, stored as is
+	e_test_half  = 1, //!< Halves
+	e_test_int   = 2, //!< Integers, maybe normalized
+};
+
+//! A declaration type & the layout of its fields
+typedef struct TEST_TYPE_T
+{
+	u32          type       ;//!< e_d3d9_decltype_*
+	const char * name       ;//!< Its name
+	u32          kind       ;//!< e_test_*
+	u32          components ;//!< Components stored
+	u32          bits       ;//!< Bits of an integer field
+	u32          sign       ;//!< Integer fields are signed
+	u32          norm       ;//!< Integer fields are normalized
+	f32          scale      ;//!< Scale of the values to the fields
+	f64          lo         ;//!< Lowest field
+	f64          hi         ;//!< Highest field
+	u32          shift[4]   ;//!< Bit of each field, of X, Y, Z & W
+}
+test_type_t; //!< A declaration type & the layout of its fields
+
+//! The declaration types
+static const test_type_t g_test_types[] =
+{
+	{ e_d3d9_decltype_float1,    "FLOAT1",    e_test_float, 1,  0, 0, 0,     1.0f,      0.0,     0.0, { 0, 0, 0, 0 } },
+	{ e_d3d9_decltype_float2,    "FLOAT2",    e_test_float, 2,  0, 0, 0,     1.0f,      0.0,     0.0, { 0, 0, 0, 0 } },
+	{ e_d3d9_decltype_float3,    "FLOAT3",    e_test_float, 3,  0, 0, 0,     1.0f,      0.0,     0.0, { 0, 0, 0, 0 } },
+	{ e_d3d9_decltype_float4,    "FLOAT4",    e_test_float, 4,  0, 0, 0,     1.0f,      0.0,     0.0, { 0, 0, 0, 0 } },
+	{ e_d3d9_decltype_d3dcolor,  "D3DCOLOR",  e_test_int,   4,  8, 0, 1,   255.0f,      0.0,   255.0, { 16, 8, 0, 24 } },
+	{ e_d3d9_decltype_ubyte4,    "UBYTE4",    e_test_int,   4,  8, 0, 0,     1.0f,      0.0,   255.0, { 0, 8, 16, 24 } },
+	{ e_d3d9_decltype_short2,    "SHORT2",    e_test_int,   2, 16, 1, 0,     1.0f, -32768.0, 32767.0, { 0, 16, 0, 0 } },
+	{ e_d3d9_decltype_short4,    "SHORT4",    e_test_int,   4, 16, 1, 0,     1.0f, -32768.0, 32767.0, { 0, 16, 32, 48 } },
+	{ e_d3d9_decltype_ubyte4n,   "UBYTE4N",   e_test_int,   4,  8, 0, 1,   255.0f,      0.0,   255.0, { 0, 8, 16, 24 } },
+	{ e_d3d9_decltype_short2n,   "SHORT2N",   e_test_int,   2, 16, 1, 1, 32767.0f, -32767.0, 32767.0, { 0, 16, 0, 0 } },
+	{ e_d3d9_decltype_short4n,   "SHORT4N",   e_test_int,   4, 16, 1, 1, 32767.0f, -32767.0, 32767.0, { 0, 16, 32, 48 } },
+	{ e_d3d9_decltype_ushort2n,  "USHORT2N",  e_test_int,   2, 16, 0, 1, 65535.0f,      0.0, 65535.0, { 0, 16, 0, 0 } },
+	{ e_d3d9_decltype_ushort4n,  "USHORT4N",  e_test_int,   4, 16, 0, 1, 65535.0f,      0.0, 65535.0, { 0, 16, 32, 48 } },
+	{ e_d3d9_decltype_udec3,     "UDEC3",     e_test_int,   3, 10, 0, 0,     1.0f,      0.0,  1023.0, { 0, 10, 20, 0 } },
+	{ e_d3d9_decltype_dec3n,     "DEC3N",     e_test_int,   3, 10, 1, 1,   511.0f,   -511.0,   511.0, { 0, 10, 20, 0 } },
+	{ e_d3d9_decltype_float16_2, "FLOAT16_2", e_test_half,  2,  0, 0, 0,     1.0f,      0.0,     0.0, { 0, 0, 0, 0 } },
+	{ e_d3d9_decltype_float16_4, "FLOAT16_4", e_test_half,  4,  0, 0, 0,     1.0f,      0.0,     0.0, { 0, 0, 0, 0 } },
+};
+
+//! Number of declaration types
+#define TEST_TYPES ( sizeof( g_test_types ) / sizeof( g_test_types[0] ) )
+
+//! Names of the instruction sets
+static const char * const g_test_isa[3] = { "scalar", "sse2", "avx2" };
+
+//! Inputs at the first vertices, the others are random
+static const f32 g_test_special[] =
+{
+	0.0f, -0.0f, 0.5f, -0.5f, 1.5f, -1.5f, 2.5f, 1.0f, -1.0f, 0.5f / 255.0f, 1.5f / 511.0f,
+	1e-8f, 65520.0f, -70000.0f, 1e30f, 254.5f, 1022.5f, 32767.5f, -32768.5f, 65535.0f
+};
+
+//! Number of special inputs
+#define TEST_SPECIAL ( sizeof( g_test_special ) / sizeof( g_test_special[0] ) )
+
+
+/****************************************************************************
+ * Reference
+ ****************************************************************************/
+
+//! Get a random float in [lo, hi)
+static f32 test_uniform( u32 * seed, f64 lo, f64 hi )
+{
+	return (f32)( lo + ( hi - lo ) * test_rand( seed ) / 16777216.0 );
+}
+
+//! Get the field of a value, whether it is within a float step of a tie
+static s32 test_quantize( const test_type_t * t, f32 v, hbool * tie )
+{
+	f64 x = (f64)( v * t->scale );
+	f64 a;
+
+	*tie = hf_false;
+
+	if ( isnan( x ) || x < t->lo )
+	{
+		return (s32) t->lo;
+	}
+
+	if ( x > t->hi )
+	{
+		return (s32) t->hi;
+	}
+
+	a    = fabs( x );
+	*tie = fabs( a - floor( a ) - 0.5 ) <= 1e-6 * ( a > 1.0 ? a : 1.0 );
+	a    = floor( a + 0.5 );
+
+	return (s32)( x < 0.0 ? -a : a );
+}
+
+//! Reads field @p c of a packed vertex
+static s32 test_field( const test_type_t * t, const u08 * p, u32 c )
+{
+	u64 v = 0;
+	u32 m = ( 1u << t->bits ) - 1;
+	u32 f;
+
+	memcpy( & v, p, d3d9_vpak_type_size( t->type ) );
+
+	f = (u32)( v >> t->shift[c] ) & m;
+
+	return t->sign && f >> ( t->bits - 1 ) ? (s32) f - (s32)( m + 1 ) : (s32) f;
+}
+
+//! Get the value the vertex shader sees of a field
+static f64 test_value( const test_type_t * t, s32 q )
+{
+	f64 v = (f64) q;
+
+	if ( t->norm )
+	{
+		v /= t->scale;
+		v  = v < -1.0 ? -1.0 : v;
+	}
+
+	return v;
+}
+
+//! Checks a packed vertex, @return the number of wrong components
+static u32 test_check_packed( const test_type_t * t, const u08 * p, const f32 v[4] )
+{
+	u32 bad = 0;
+	u32 c;
+
+	for ( c = 0; c < t->components; c++ )
+	{
+		hbool tie;
+		s32   q;
+		s32   f;
+		u16   h;
+		u32   x;
+
+		switch ( t->kind )
+		{
+		case e_test_float:
+			memcpy( & x, p + 4 * c, 4 );
+			bad += memcmp( & x, & v[c], 4 ) != 0;
+			break;
+
+		// halves are checked against their reference in conv.c
+		case e_test_half:
+			memcpy( & h, p + 2 * c, 2 );
+			bad += h != d3d9_conv_f32_to_f16( v[c] );
+			break;
+
+		case e_test_int:
+			q    = test_quantize( t, v[c], & tie );
+			f    = test_field( t, p, c );
+			bad += f != q && !( tie && ( f - q == 1 || q - f == 1 ) );
+			break;
+		}
+	}
+
+	return bad;
+}
+
+//! Checks an unpacked vertex, @return the number of wrong components
+static u32 test_check_unpacked( const test_type_t * t, const u08 * p, const f32 v[4] )
+{
+	u32 bad = 0;
+	u32 c;
+
+	for ( c = 0; c < 4; c++ )
+	{
+		f64 r = c == 3 ? 1.0 : 0.0;
+		u16 h;
+		f32 f;
+
+		if ( c < t->components )
+		{
+			switch ( t->kind )
+			{
+			case e_test_float:
+				memcpy( & f, p + 4 * c, 4 );
+				bad += memcmp( & f, & v[c], 4 ) != 0;
+				continue;
+
+			case e_test_half:
+				memcpy( & h, p + 2 * c, 2 );
+				f    = d3d9_conv_f16_to_f32( h );
+				bad += memcmp( & f, & v[c], 4 ) != 0;
+				continue;
+
+			case e_test_int:
+				r = test_value( t, test_field( t, p, c ) );
+				break;
+			}
+		}
+
+		bad += !( fabs( v[c] - r ) <= 1e-7 * ( fabs( r ) > 1.0 ? fabs( r ) : 1.0 ) );
+	}
+
+	return bad;
+}
+
+
+/****************************************************************************
+ * Tests
+ ****************************************************************************/
+
+//! Streams & arrays of a type test
+typedef struct TEST_VERTICES_T
+{
+	d3d9_vpak_plan_t   plan        ;//!< Type, neighbour, and element of stream 1
+	d3d9_vpak_input_t  in[3]       ;//!< Inputs of the elements
+	d3d9_vpak_output_t out[3]      ;//!< Outputs of the elements
+	f32              * src[4]      ;//!< Input components
+	f32              * dst[4]      ;//!< Output components
+	u08              * stream[2]   ;//!< Streams written by scalar
+	u08              * copy[2]     ;//!< Streams written by the others
+	f32              * unpacked[4] ;//!< Outputs of scalar
+	u32                count       ;//!< Number of vertices
+}
+test_vertices_t; //!< Streams & arrays of a type test
+
+//! Packs & unpacks a type with each instruction set, @return the round trip error
+static f64 test_type( const test_type_t * t, u32 count, u32 threads, hbool missing )
+{
+	d3d9_vertexelement_t decl[] =
+	{
+		{ 0, 0, 0,                        e_d3d9_declmethod_default, e_d3d9_declusage_texcoord, 0 },
+		{ 1, 0, e_d3d9_decltype_float1,   e_d3d9_declmethod_default, e_d3d9_declusage_position, 0 },
+		{ 0, 0, e_d3d9_decltype_d3dcolor, e_d3d9_declmethod_default, e_d3d9_declusage_color,    0 },
+		D3D9_DECL_END()
+	};
+	d3d9_parallel_t par   = test_parallel( threads );
+	test_vertices_t v;
+	u32             isa   = d3d9_conv_isa();
+	u32             seed  = t->type * 977 + count;
+	u32             bad   = 0;
+	f64             error = 0.0;
+	u32             i;
+	u32             c;
+	u32             k;
+
+	decl[0].type = (u08) t->type;
+
+	d3d9_vpak_offsets( decl );
+	TEST_CHECK( d3d9_vpak_compile( & v.plan, decl ) == D3D9_OK );
+	TEST_CHECK( v.plan.stride[0] == d3d9_vpak_type_size( t->type ) + 4 && v.plan.stride[1] == 4 );
+
+	memset( & v.in, 0, sizeof( v.in ) );
+	memset( & v.out, 0, sizeof( v.out ) );
+
+	for ( c = 0; c < 4; c++ )
+	{
+		f64 lo = t->kind == e_test_int ? t->lo / t->scale : -1.0;
+		f64 hi = t->kind == e_test_int ? t->hi / t->scale :  1.0;
+
+		v.src[c]      = (f32 *) malloc( count * 4 );
+		v.dst[c]      = (f32 *) malloc( count * 4 );
+		v.unpacked[c] = (f32 *) malloc( count * 4 );
+
+		// a bit out of range on each side, special values first
+		for ( i = 0; i < count; i++ )
+		{
+			v.src[c][i] = i < TEST_SPECIAL
+			            ? g_test_special[ ( i + c ) % TEST_SPECIAL ]
+			            : test_uniform( & seed, lo - 0.1 * ( hi - lo ), hi + 0.1 * ( hi - lo ) );
+		}
+
+		if ( count > TEST_SPECIAL )
+		{
+			u32 nan = 0x7FC00000u;
+
+			memcpy( & v.src[c][ TEST_SPECIAL ], & nan, 4 );
+			v.src[c][ TEST_SPECIAL - 1 ] = c & 1 ? INFINITY : -INFINITY;
+		}
+
+		v.in[0].c[c]  = missing && ( c & 1 ) ? nullp : v.src[c];
+		v.out[0].c[c] = v.dst[c];
+	}
+
+	v.in[1].c[0] = v.src[3];
+
+	for ( k = 0; k < 2; k++ )
+	{
+		v.stream[k] = (u08 *) malloc( (size_t) count * v.plan.stride[k] );
+		v.copy[k]   = (u08 *) malloc( (size_t) count * v.plan.stride[k] );
+	}
+
+	// each instruction set, then the best one on threads
+	for ( k = 0; k <= isa + 1; k++ )
+	{
+		u08 ** s = k ? v.copy : v.stream;
+
+		d3d9_conv_set_isa( k <= isa ? k : isa );
+
+		memset( s[0], 0xAB, (size_t) count * v.plan.stride[0] );
+		memset( s[1], 0xAB, (size_t) count * v.plan.stride[1] );
+
+		d3d9_vpak_pack( & v.plan, (void * const *) s, v.in, count, k <= isa ? nullp : & par );
+		d3d9_vpak_unpack( & v.plan, v.out, (const void * const *) s, count, k <= isa ? nullp : & par );
+
+		if ( !k )
+		{
+			for ( c = 0; c < 4; c++ )
+			{
+				memcpy( v.unpacked[c], v.dst[c], count * 4 );
+			}
+
+			continue;
+		}
+
+		bad += memcmp( v.copy[0], v.stream[0], (size_t) count * v.plan.stride[0] ) != 0;
+		bad += memcmp( v.copy[1], v.stream[1], (size_t) count * v.plan.stride[1] ) != 0;
+
+		for ( c = 0; c < 4; c++ )
+		{
+			bad += memcmp( v.unpacked[c], v.dst[c], count * 4 ) != 0;
+		}
+
+		if ( bad )
+		{
+			printf( "vpak: %s, %u vertices, %s%s differs from scalar\n", t->name, count,
+				g_test_isa[ k <= isa ? k : isa ], k <= isa ? "" : " on threads" );
+		}
+	}
+
+	d3d9_conv_set_isa( isa );
+
+	// the scalar streams & floats against the reference
+	for ( i = 0; i < count; i++ )
+	{
+		const u08 * p = v.stream[0] + (size_t) i * v.plan.stride[0];
+		f32         in[4];
+		f32         out[4];
+		u32         neighbour;
+
+		for ( c = 0; c < 4; c++ )
+		{
+			in[c]  = v.in[0].c[c] ? v.src[c][i] : c == 3 ? 1.0f : 0.0f;
+			out[c] = v.unpacked[c][i];
+		}
+
+		memcpy( & neighbour, p + v.plan.stride[0] - 4, 4 );
+
+		bad += test_check_packed( t, p, in );
+		bad += test_check_unpacked( t, p, out );
+		bad += neighbour != 0xFF000000u;
+		bad += memcmp( v.stream[1] + 4 * i, & v.src[3][i], 4 ) != 0;
+
+		for ( c = 0; c < t->components; c++ )
+		{
+			f64 x = in[c];
+			f64 e;
+
+			if ( !isfinite( x ) || i < TEST_SPECIAL )
+			{
+				continue;
+			}
+
+			if ( t->kind == e_test_int )
+			{
+				x = x < t->lo / t->scale ? t->lo / t->scale : x;
+				x = x > t->hi / t->scale ? t->hi / t->scale : x;
+			}
+
+			e = fabs( out[c] - x );
+
+			// halves to their precision, down to the smallest normal
+			if ( t->kind == e_test_half )
+			{
+				e /= fabs( x ) > ldexp( 1.0, -14 ) ? fabs( x ) : ldexp( 1.0, -14 );
+			}
+
+			error = e > error ? e : error;
+		}
+	}
+
+	TEST_CHECK( bad == 0 );
+
+	for ( k = 0; k < 2; k++ )
+	{
+		free( v.stream[k] );
+		free( v.copy[k] );
+	}
+
+	for ( c = 0; c < 4; c++ )
+	{
+		free( v.src[c] );
+		free( v.dst[c] );
+		free( v.unpacked[c] );
+	}
+
+	return error;
+}
+
+//! Unpacks random bytes of a type with each instruction set
+static void test_raw( const test_type_t * t, u32 count, u32 threads )
+{
+	d3d9_vertexelement_t decl[] =
+	{
+		{ 0, 0, 0, e_d3d9_declmethod_default, e_d3d9_declusage_texcoord, 0 },
+		D3D9_DECL_END()
+	};
+	d3d9_parallel_t      par  = test_parallel( threads );
+	d3d9_vpak_plan_t     plan;
+	d3d9_vpak_output_t   out;
+	f32                * dst[4];
+	f32                * ref[4];
+	u08                * s;
+	u32                  isa  = d3d9_conv_isa();
+	u32                  seed = t->type;
+	u32                  bad  = 0;
+	u32                  size;
+	u32                  i;
+	u32                  c;
+	u32                  k;
+
+	decl[0].type = (u08) t->type;
+
+	TEST_CHECK( d3d9_vpak_compile( & plan, decl ) == D3D9_OK );
+
+	size = count * plan.stride[0];
+	s    = (u08 *) malloc( size );
+
+	for ( i = 0; i < size; i++ )
+	{
+		s[i] = (u08) test_rand( & seed );
+	}
+
+	for ( c = 0; c < 4; c++ )
+	{
+		dst[c]   = (f32 *) malloc( count * 4 );
+		ref[c]   = (f32 *) malloc( count * 4 );
+		out.c[c] = dst[c];
+	}
+
+	// each instruction set, then the best one on threads
+	for ( k = 0; k <= isa + 1; k++ )
+	{
+		d3d9_conv_set_isa( k <= isa ? k : isa );
+		d3d9_vpak_unpack( & plan, & out, (const void * const *) & s, count, k <= isa ? nullp : & par );
+
+		for ( c = 0; c < 4; c++ )
+		{
+			if ( !k )
+			{
+				memcpy( ref[c], dst[c], count * 4 );
+			}
+
+			bad += memcmp( ref[c], dst[c], count * 4 ) != 0;
+		}
+	}
+
+	d3d9_conv_set_isa( isa );
+
+	// every field, i.e. -32768 & -512 clamped to -1
+	for ( i = 0; i < count; i++ )
+	{
+		f32 v[4];
+
+		for ( c = 0; c < 4; c++ )
+		{
+			v[c] = ref[c][i];
+		}
+
+		bad += test_check_unpacked( t, s + (size_t) i * plan.stride[0], v );
+	}
+
+	TEST_CHECK( bad == 0 );
+
+	free( s );
+
+	for ( c = 0; c < 4; c++ )
+	{
+		free( dst[c] );
+		free( ref[c] );
+	}
+}
+
+//! Packs & unpacks every type
+static void test_types( u32 threads )
+{
+	static const u32 counts[] = { 3, 257, 10007 };
+	u32              n;
+	u32              i;
+
+	for ( i = 0; i < TEST_TYPES; i++ )
+	{
+		const test_type_t * t     = & g_test_types[i];
+		f64                 error = 0.0;
+		f64                 bound;
+
+		TEST_CHECK( d3d9_vpak_type_size( t->type ) == ( t->kind == e_test_float ? 4 * t->components
+		                                               : t->kind == e_test_half  ? 2 * t->components
+		                                               : t->bits * t->components > 32 ? 8 : 4 ) );
+		TEST_CHECK( d3d9_vpak_type_components( t->type ) == t->components );
+
+		for ( n = 0; n < sizeof( counts ) / sizeof( counts[0] ); n++ )
+		{
+			f64 e = test_type( t, counts[n], threads, hf_false );
+
+			error = e > error ? e : error;
+
+			test_type( t, counts[n], threads, hf_true );
+			test_raw( t, counts[n] * 7, threads );
+		}
+
+		// half a step, or half the precision of a half, and float rounding
+		bound = t->kind == e_test_int  ? 0.5 / t->scale
+		      : t->kind == e_test_half ? ldexp( 1.0, -11 )
+		      : 0.0;
+
+		TEST_CHECK( error <= bound + 1e-6 );
+
+		printf( "vpak: %-9s round trip error %.3g, at most %.3g%s\n",
+			t->name, error, bound, t->kind == e_test_half ? " (relative)" : "" );
+	}
+
+	TEST_CHECK( d3d9_vpak_type_size( e_d3d9_decltype_unused ) == 0 );
+	TEST_CHECK( d3d9_vpak_type_components( e_d3d9_decltype_unused ) == 0 );
+}
+
+//! Compiles good & bad declarations
+static void test_compile( void )
+{
+	d3d9_vertexelement_t good[] =
+	{
+		{ 2, 0, e_d3d9_decltype_short2n,   e_d3d9_declmethod_default, e_d3d9_declusage_texcoord, 1 },
+		{ 0, 0, e_d3d9_decltype_float3,    e_d3d9_declmethod_default, e_d3d9_declusage_position, 0 },
+		{ 0, 0, e_d3d9_decltype_d3dcolor,  e_d3d9_declmethod_default, e_d3d9_declusage_color,    0 },
+		{ 2, 0, e_d3d9_decltype_float16_4, e_d3d9_declmethod_default, e_d3d9_declusage_texcoord, 2 },
+		{ 0, 0, e_d3d9_decltype_dec3n,     e_d3d9_declmethod_default, e_d3d9_declusage_normal,   0 },
+		D3D9_DECL_END()
+	};
+	d3d9_vertexelement_t bad[3];
+	d3d9_vertexelement_t huge[ D3D9_MAXD3DDECLLENGTH + 1 ];
+	d3d9_vpak_plan_t     plan;
+	u32                  i;
+
+	d3d9_vpak_offsets( good );
+
+	TEST_CHECK( good[0].offset == 0 && good[3].offset == 4 );
+	TEST_CHECK( good[1].offset == 0 && good[2].offset == 12 && good[4].offset == 16 );
+	TEST_CHECK( d3d9_vpak_compile( & plan, good ) == D3D9_OK );
+	TEST_CHECK( plan.count == 5 && plan.streams == 0x5 );
+	TEST_CHECK( plan.stride[0] == 20 && plan.stride[1] == 0 && plan.stride[2] == 12 );
+
+	// by stream & offset, each knowing its element
+	TEST_CHECK( plan.op[0].element == 1 && plan.op[1].element == 2 && plan.op[2].element == 4 );
+	TEST_CHECK( plan.op[3].element == 0 && plan.op[4].element == 3 );
+	TEST_CHECK( plan.op[4].stream == 2 && plan.op[4].offset == 4 && plan.op[4].components == 4 );
+
+	// each of these breaks a rule
+	for ( i = 0; i < 9; i++ )
+	{
+		d3d9_vertexelement_t e = { 0, 0, e_d3d9_decltype_float3, e_d3d9_declmethod_default, e_d3d9_declusage_position, 0 };
+		d3d9_vertexelement_t end = D3D9_DECL_END();
+
+		bad[0] = e;
+		bad[1] = e;
+		bad[2] = end;
+
+		bad[1].usage  = e_d3d9_declusage_normal;
+		bad[1].offset = 12;
+
+		switch ( i )
+		{
+		case 0: bad[1].offset     = 8;                         break; // overlaps
+		case 1: bad[1].usage      = e_d3d9_declusage_position; break; // repeated
+		case 2: bad[1].offset     = 14;                        break; // unaligned
+		case 3: bad[1].stream     = D3D9_VPAK_STREAMS;         break;
+		case 4: bad[1].type       = e_d3d9_decltype_unused;    break;
+		case 5: bad[1].method     = 1;                         break;
+		case 6: bad[1].usage      = e_d3d9_declusage_sample + 1; break;
+		case 7: bad[1].usageIndex = D3D9_MAXD3DDECLUSAGEINDEX + 1; break;
+		case 8: bad[1].stream     = 1;                         break; // fine
+		}
+
+		TEST_CHECK( ( d3d9_vpak_compile( & plan, bad ) == D3D9_OK ) == ( i == 8 ) );
+	}
+
+	// not ended in time
+	for ( i = 0; i <= D3D9_MAXD3DDECLLENGTH; i++ )
+	{
+		d3d9_vertexelement_t e = { 0, 0, e_d3d9_decltype_float1, e_d3d9_declmethod_default, e_d3d9_declusage_texcoord, 0 };
+
+		huge[i]            = e;
+		huge[i].stream     = (u16)( i % D3D9_VPAK_STREAMS );
+		huge[i].usageIndex = (u08)( i / D3D9_VPAK_STREAMS );
+	}
+
+	TEST_CHECK( d3d9_vpak_compile( & plan, huge ) == D3D9_ERR_INVALIDCALL );
+}
+
+//! Packs a vertex of 8 elements the way a loader would, one at a time
+static void test_naive( const d3d9_vertexelement_t * decl, u08 * const * streams,
+	const d3d9_vpak_input_t * in, u32 count, const u32 * stride )
+{
+	u32 i;
+	u32 e;
+	u32 c;
+
+	for ( i = 0; i < count; i++ )
+	{
+		for ( e = 0; decl[e].stream != 0xFF; e++ )
+		{
+			f32 v[4];
+
+			for ( c = 0; c < 4; c++ )
+			{
+				v[c] = in[e].c[c] ? in[e].c[c][i] : c == 3 ? 1.0f : 0.0f;
+			}
+
+			d3d9_vpak_encode( decl[e].type,
+				streams[ decl[e].stream ] + (size_t) i * stride[ decl[e].stream ] + decl[e].offset, v );
+		}
+	}
+}
+
+//! Prints the vertices per second of a typical vertex
+static void test_bench( u32 count, u32 threads )
+{
+	d3d9_vertexelement_t decl[] =
+	{
+		{ 0, 0, e_d3d9_decltype_float3,    e_d3d9_declmethod_default, e_d3d9_declusage_position,     0 },
+		{ 0, 0, e_d3d9_decltype_dec3n,     e_d3d9_declmethod_default, e_d3d9_declusage_normal,       0 },
+		{ 0, 0, e_d3d9_decltype_ubyte4n,   e_d3d9_declmethod_default, e_d3d9_declusage_tangent,      0 },
+		{ 0, 0, e_d3d9_decltype_float16_2, e_d3d9_declmethod_default, e_d3d9_declusage_texcoord,     0 },
+		{ 0, 0, e_d3d9_decltype_d3dcolor,  e_d3d9_declmethod_default, e_d3d9_declusage_color,        0 },
+		{ 1, 0, e_d3d9_decltype_short2n,   e_d3d9_declmethod_default, e_d3d9_declusage_texcoord,     1 },
+		{ 1, 0, e_d3d9_decltype_ushort4n,  e_d3d9_declmethod_default, e_d3d9_declusage_blendweight,  0 },
+		{ 1, 0, e_d3d9_decltype_ubyte4,    e_d3d9_declmethod_default, e_d3d9_declusage_blendindices, 0 },
+		D3D9_DECL_END()
+	};
+	d3d9_parallel_t    par  = test_parallel( threads );
+	d3d9_vpak_plan_t   plan;
+	d3d9_vpak_input_t  in[8];
+	d3d9_vpak_output_t out[8];
+	f32              * a[4];
+	f32              * o[4];
+	u08              * s[ D3D9_VPAK_STREAMS ];
+	u32                isa  = d3d9_conv_isa();
+	u32                seed = 3;
+	u64                best[5];
+	u32                k;
+	u32                r;
+	u32                i;
+	u32                c;
+
+	d3d9_vpak_offsets( decl );
+	TEST_CHECK( d3d9_vpak_compile( & plan, decl ) == D3D9_OK );
+
+	for ( c = 0; c < 4; c++ )
+	{
+		a[c] = (f32 *) malloc( count * 4 );
+		o[c] = (f32 *) malloc( count * 4 );
+
+		for ( i = 0; i < count; i++ )
+		{
+			a[c][i] = test_uniform( & seed, 0.0, 1.0 );
+		}
+	}
+
+	for ( i = 0; i < 8; i++ )
+	{
+		for ( c = 0; c < 4; c++ )
+		{
+			in[i].c[c]  = a[ ( c + i ) & 3 ];
+			out[i].c[c] = o[c];
+		}
+	}
+
+	memset( s, 0, sizeof( s ) );
+
+	s[0] = (u08 *) malloc( (size_t) count * plan.stride[0] );
+	s[1] = (u08 *) malloc( (size_t) count * plan.stride[1] );
+
+	// one at a time, each instruction set, on threads, unpacking
+	for ( k = 0; k < 5; k++ )
+	{
+		best[k] = ~(u64) 0;
+
+		if ( k >= 1 && k <= 3 && k - 1 > isa )
+		{
+			continue;
+		}
+
+		d3d9_conv_set_isa( k >= 1 && k <= 3 ? k - 1 : isa );
+
+		for ( r = 0; r < 5; r++ )
+		{
+			u64 t = d3d9_ticks();
+
+			if ( k == 0 )
+			{
+				test_naive( decl, s, in, count, plan.stride );
+			}
+			else
+			{
+				d3d9_vpak_pack( & plan, (void * const *) s, in, count, k == 4 ? & par : nullp );
+			}
+
+			t       = d3d9_ticks() - t;
+			best[k] = t < best[k] ? t : best[k];
+		}
+	}
+
+	{
+		u64 unpack = ~(u64) 0;
+
+		for ( r = 0; r < 5; r++ )
+		{
+			u64 t = d3d9_ticks();
+
+			d3d9_vpak_unpack( & plan, out, (const void * const *) s, count, nullp );
+
+			t      = d3d9_ticks() - t;
+			unpack = t < unpack ? t : unpack;
+		}
+
+		printf( "vpak: %u vertices of %u + %u bytes, 8 elements, Mvertices/s:\n",
+			count, plan.stride[0], plan.stride[1] );
+		printf( "vpak:   one at a time %.1f", count / 1000.0 / test_ms( best[0] ) );
+
+		for ( k = 1; k <= 3 && k - 1 <= isa; k++ )
+		{
+			printf( ", %s %.1f", g_test_isa[ k - 1 ], count / 1000.0 / test_ms( best[k] ) );
+		}
+
+		printf( ", %u threads %.1f, unpack %.1f\n", threads,
+			count / 1000.0 / test_ms( best[4] ), count / 1000.0 / test_ms( unpack ) );
+	}
+
+	d3d9_conv_set_isa( isa );
+
+	free( s[0] );
+	free( s[1] );
+
+	for ( c = 0; c < 4; c++ )
+	{
+		free( a[c] );
+		free( o[c] );
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	u32 count   = test_arg( argc, argv, 1, 1u << 20 );
+	u32 threads = test_arg( argc, argv, 2, 4 );
+
+	test_types( threads );
+	test_compile();
+	test_bench( count, threads );
+
+	return test_done( "vpak" );
+}